@@ -1,3 +1,4 @@
-glslangValidator.exe -V main.vert
-glslangValidator.exe -V main.frag
+glslangValidator.exe -V main.vert -o main.vert.spv
+glslangValidator.exe -V main.frag -o main.frag.spv
+glslangValidator.exe -V main_bindless.frag -o main_bindless.frag.spv
 pause
\ No newline at end of file
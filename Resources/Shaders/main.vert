@@ -1,4 +1,4 @@
-#version 400
+#version 450
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 
@@ -8,23 +8,39 @@ layout (std140, binding = 2, set = 0) uniform PerFrameData
 	int frameCount;
 } perFrameData;
 
-layout (std140, binding = 0, set = 2) uniform PerModelData 
+struct ModelData
 {
 	mat4 m;
-    mat4 mvp;
+	mat4 mvp;
+	//Slot in the bindless texture table
+	uint diffuseTexture;
+};
+
+layout (std430, binding = 0, set = 2) readonly buffer PerModelData 
+{
+	ModelData models[];
 } perModelData;
 
+//The object of the draw, indirect draws add their first instance
+layout (push_constant) uniform PerDrawConstants
+{
+	uint objectIndex;
+} perDrawConstants;
+
 layout (location = 0) in vec3 pos;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 inTexCoord;
 
 layout (location = 0) out vec3 outNormal;
 layout (location = 1) out vec2 outTexCoord;
+layout (location = 2) flat out uint outDiffuseTexture;
 
 void main() 
 {
-	outNormal = mat3(perModelData.m) * inNormal;
+	ModelData model = perModelData.models[perDrawConstants.objectIndex + gl_InstanceIndex];
+	outNormal = mat3(model.m) * inNormal;
 	outTexCoord = inTexCoord;
+	outDiffuseTexture = model.diffuseTexture;
 
-	gl_Position = perModelData.mvp * vec4(pos, 1);
+	gl_Position = model.mvp * vec4(pos, 1);
 }
\ No newline at end of file
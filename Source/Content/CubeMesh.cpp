@@ -83,7 +83,7 @@ CubeMesh::CubeMesh(Graphics* pGraphics) :
 
 	m_pVertexBuffer = std::make_unique<VertexBuffer>(pGraphics);
 	m_pVertexBuffer->SetSize((int)vertices.size() * sizeof(Vertex));
-	m_pVertexBuffer->SetData((int)vertices.size(), 0, vertices.data());
+	m_pVertexBuffer->SetData((int)vertices.size() * sizeof(Vertex), 0, vertices.data());
 }
 
 CubeMesh::~CubeMesh()
@@ -6,8 +6,11 @@
 #include "Core/Graphics.h"
 
 #include "Helpers/VulkanHelpers.h"
-#include "Core/DescriptorPool.h"
+#include "Core/DescriptorCache.h"
+#include "Core/BindlessTextureTable.h"
 #include "Resource/Texture2D.h"
+#include "Core/DeferredReleaseQueue.h"
+#include "Core/UploadManager.h"
 
 Material::Material(Graphics* pGraphics) :
 	m_pGraphics(pGraphics)
@@ -17,8 +20,13 @@ Material::Material(Graphics* pGraphics) :
 
 Material::~Material()
 {
+	UnregisterTextures();
 	m_Textures.clear();
-	vkDestroyPipeline(m_pGraphics->GetDevice(), m_Pipeline, nullptr);
+	m_pGraphics->GetReleaseQueue()->ReleasePipeline(m_Pipeline);
+	if (m_FallbackPipeline != VK_NULL_HANDLE)
+	{
+		m_pGraphics->GetReleaseQueue()->ReleasePipeline(m_FallbackPipeline);
+	}
 }
 
 void Material::GetTypeAndSizeFromString(const std::string& type, VkFormat& format, int& size)
@@ -77,22 +85,50 @@ void Material::Load(const std::string& fileName)
 	std::string name = pRootNode->Attribute("name");
 
 	XML::XMLElement* pCurrent =	pRootNode->FirstChildElement("Shaders");
-	XML::XMLElement* pShaderElement = pCurrent->FirstChildElement("Shader");
-	while (pShaderElement != nullptr)
+	//Returns false when a shader doesn't load, 'bindless' picks the shaders that index the bindless texture table
+	auto loadShaders = [this, pCurrent](bool bindless)
 	{
-		std::unique_ptr<Shader> pShader = std::make_unique<Shader>(m_pGraphics->GetDevice());
-		
-		std::string stage = pShaderElement->Attribute("type");
-		VkShaderStageFlagBits shaderStage = GetShaderStageFromString(stage);
+		m_Shaders.clear();
+		XML::XMLElement* pShaderElement = pCurrent->FirstChildElement("Shader");
+		while (pShaderElement != nullptr)
+		{
+			std::unique_ptr<Shader> pShader = std::make_unique<Shader>(m_pGraphics->GetDevice());
+
+			std::string stage = pShaderElement->Attribute("type");
+			VkShaderStageFlagBits shaderStage = GetShaderStageFromString(stage);
 
-		pShader->Load(pShaderElement->Attribute("path"), shaderStage);
-		m_Shaders.push_back(std::move(pShader));
+			const char* pPath = pShaderElement->Attribute("path");
+			if (bindless && pShaderElement->Attribute("bindlessPath"))
+			{
+				pPath = pShaderElement->Attribute("bindlessPath");
+			}
+			if (pShader->Load(pPath, shaderStage) == false)
+			{
+				std::cout << "Failed to load shader '" << pPath << "'" << std::endl;
+				return false;
+			}
+			m_Shaders.push_back(std::move(pShader));
 
-		pShaderElement = pShaderElement->NextSiblingElement();
+			pShaderElement = pShaderElement->NextSiblingElement();
+		}
+		return true;
+	};
+
+	//The bindless variants are picked when the device supports them, the regular shaders are the fallback
+	bool hasBindlessShaders = false;
+	for (XML::XMLElement* pShaderElement = pCurrent->FirstChildElement("Shader"); pShaderElement != nullptr; pShaderElement = pShaderElement->NextSiblingElement())
+	{
+		hasBindlessShaders |= pShaderElement->Attribute("bindlessPath") != nullptr;
+	}
+	m_Bindless = m_pGraphics->GetBindlessTextures() && hasBindlessShaders && loadShaders(true);
+	if (m_Bindless == false)
+	{
+		loadShaders(false);
 	}
 
 	pCurrent = pRootNode->FirstChildElement("Resources");
 	XML::XMLElement* pResource = pCurrent->FirstChildElement();
+	m_pGraphics->GetUploadManager()->BeginBatch();
 	while (pResource)
 	{
 		if (strcmp(pResource->Value(), "Texture2D") == 0)
@@ -104,13 +140,17 @@ void Material::Load(const std::string& fileName)
 
 			if (binding == "Diffuse")
 			{
+				//The textures are owned by the material, so the listener never outlives it
+				pTexture->AddRelocationListener([this]() { UpdateDescriptorSet(); });
 				m_Textures[(int)DescriptorBinding::DiffuseTexture] = std::move(pTexture);
 			}
 		}
 		pResource = pResource->NextSiblingElement();
 	}
+	m_pGraphics->GetUploadManager()->EndBatch();
 
 	pCurrent = pRootNode->FirstChildElement("Pipeline");
+	m_PerDrawConstants = pCurrent->BoolAttribute("perDrawConstants");
 	pCurrent = pCurrent->FirstChildElement("VertexLayout");
 	XML::XMLElement* pVertexElement = pCurrent->FirstChildElement();
 	
@@ -181,15 +221,8 @@ void Material::Load(const std::string& fileName)
 	//MSAA state
 	VkPipelineMultisampleStateCreateInfo multiSampleStateInfo = VkHelpers::MultisampleState();
 
-	std::vector<VkPipelineShaderStageCreateInfo> shaderCreateInfos;
-	for (auto& pShader : m_Shaders)
-	{
-		shaderCreateInfos.push_back(VkHelpers::ShaderCreateInfo::Construct("main", pShader->GetStage(), pShader->GetShaderObject()));
-	}
-
-	//Graphics pipeline
+	//Graphics pipeline from the loaded shaders
 	VkGraphicsPipelineCreateInfo pipelineInfo = VkHelpers::GraphicsPipelineDescriptor();
-	pipelineInfo.layout = m_pGraphics->GetPipelineLayout();
 	pipelineInfo.pVertexInputState = &vertexStateInfo;
 	pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
 	pipelineInfo.pRasterizationState = &rasterizerStateInfo;
@@ -198,33 +231,109 @@ void Material::Load(const std::string& fileName)
 	pipelineInfo.pDynamicState = &dynamicState;
 	pipelineInfo.pViewportState = &viewportStateInfo;
 	pipelineInfo.pDepthStencilState = &depthStencilStateInfo;
-	pipelineInfo.pStages = shaderCreateInfos.data();
-	pipelineInfo.stageCount = (unsigned int)shaderCreateInfos.size();
 	pipelineInfo.renderPass = m_pGraphics->GetRenderPass();
+	auto createPipeline = [this, &pipelineInfo](bool bindless)
+	{
+		std::vector<VkPipelineShaderStageCreateInfo> shaderCreateInfos;
+		for (auto& pShader : m_Shaders)
+		{
+			shaderCreateInfos.push_back(VkHelpers::ShaderCreateInfo::Construct("main", pShader->GetStage(), pShader->GetShaderObject()));
+		}
+		pipelineInfo.layout = m_pGraphics->GetPipelineLayout(bindless);
+		pipelineInfo.pStages = shaderCreateInfos.data();
+		pipelineInfo.stageCount = (unsigned int)shaderCreateInfos.size();
+
+		VkPipeline pipeline;
+		vkCreateGraphicsPipelines(m_pGraphics->GetDevice(), m_pGraphics->GetPipelineCache(), 1, &pipelineInfo, nullptr, &pipeline);
+		return pipeline;
+	};
+	m_Pipeline = createPipeline(m_Bindless);
+
+	//The table can fill up when textures are registered again after they moved, so the regular shaders are kept ready
+	if (m_Bindless && loadShaders(false))
+	{
+		m_FallbackPipeline = createPipeline(false);
+	}
 
-	vkCreateGraphicsPipelines(m_pGraphics->GetDevice(), m_pGraphics->GetPipelineCache(), 1, &pipelineInfo, nullptr, &m_Pipeline);
-	
-	m_DescriptorSet = m_pGraphics->GetDestriptorSet(DescriptorGroup::Material);
+	UpdateDescriptorSet();
+}
+
+VkPipelineLayout Material::GetPipelineLayout() const
+{
+	return m_pGraphics->GetPipelineLayout(m_Bindless);
+}
 
-	std::vector<VkWriteDescriptorSet> writes;
+VkDescriptorSet Material::GetDescriptorSet()
+{
+	//Every bindless material binds the same set, so switching materials doesn't rebind it
+	if (m_Bindless)
+	{
+		return m_pGraphics->GetBindlessTextures()->GetSet();
+	}
+	return m_pGraphics->GetDescriptorCache()->GetSet(m_pGraphics->GetDescriptorSetLayout(DescriptorGroup::Material), m_DescriptorWrites);
+}
+
+void Material::UpdateDescriptorSet()
+{
+	if (m_Bindless)
+	{
+		if (RegisterTextures())
+		{
+			return;
+		}
+		//Same as when the bindless shaders don't load, the regular shaders read the textures from the per-material set
+		std::cout << "Bindless texture table is full, falling back to the per-material descriptor set" << std::endl;
+		m_Bindless = false;
+		if (m_FallbackPipeline != VK_NULL_HANDLE)
+		{
+			m_pGraphics->GetReleaseQueue()->ReleasePipeline(m_Pipeline);
+			m_Pipeline = m_FallbackPipeline;
+			m_FallbackPipeline = VK_NULL_HANDLE;
+		}
+	}
+
+	m_DescriptorWrites.clear();
+	for (const auto& tex : m_Textures)
+	{
+		DescriptorWrite write;
+		write.Binding = tex.first;
+		write.Type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.View = (VkImageView)tex.second->GetView();
+		write.Sampler = (VkSampler)tex.second->GetSampler();
+		write.Layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		m_DescriptorWrites.push_back(write);
+	}
+}
+
+uint32 Material::GetTextureSlot(int binding) const
+{
+	auto it = m_TextureSlots.find(binding);
+	return it != m_TextureSlots.end() ? it->second : 0;
+}
+
+bool Material::RegisterTextures()
+{
+	//The old slots stay valid until the frames in flight are done with them
+	UnregisterTextures();
+	BindlessTextureTable* pBindlessTextures = m_pGraphics->GetBindlessTextures();
 	for (const auto& tex : m_Textures)
 	{
-		VkDescriptorImageInfo texInfo;
-		texInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		texInfo.imageView = (VkImageView)tex.second->GetView();
-		texInfo.sampler = (VkSampler)tex.second->GetSampler();
-
-		VkWriteDescriptorSet write = {};
-		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		write.descriptorCount = 1;
-		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		write.dstBinding = tex.first;
-		write.dstSet = m_DescriptorSet;
-		write.pImageInfo = &texInfo;
-		write.pNext = nullptr;
-		write.dstArrayElement = 0;
-
-		writes.push_back(write);
-	}
-	vkUpdateDescriptorSets(m_pGraphics->GetDevice(), writes.size(), writes.data(), 0, nullptr);
-}
\ No newline at end of file
+		uint32 slot = pBindlessTextures->Register((VkImageView)tex.second->GetView(), (VkSampler)tex.second->GetSampler());
+		if (slot == BindlessTextureTable::INVALID_SLOT)
+		{
+			UnregisterTextures();
+			return false;
+		}
+		m_TextureSlots[tex.first] = slot;
+	}
+	return true;
+}
+
+void Material::UnregisterTextures()
+{
+	for (const auto& slot : m_TextureSlots)
+	{
+		m_pGraphics->GetBindlessTextures()->Unregister(slot.second);
+	}
+	m_TextureSlots.clear();
+}
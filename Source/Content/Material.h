@@ -3,6 +3,7 @@
 class Shader;
 class Graphics;
 class Texture2D;
+struct DescriptorWrite;
 
 class Material
 {
@@ -11,17 +12,35 @@ public:
 	~Material();
 
 	VkPipeline GetPipeline() { return m_Pipeline; }
+	VkPipelineLayout GetPipelineLayout() const;
 	virtual void Load(const std::string& fileName);
-	VkDescriptorSet GetDescriptorSet() { return m_DescriptorSet; }
+	//Shared with every material that binds the same textures, only valid for the current frame
+	VkDescriptorSet GetDescriptorSet();
+	//Draws one by one with the object index in the push constants instead of with indirect draws
+	bool UsesPerDrawConstants() const { return m_PerDrawConstants; }
+	//Picks up textures that were moved or recreated, called by the textures when the Defragmenter moves them
+	void UpdateDescriptorSet();
+	//Slot of the texture in the bindless texture table, 0 when the material doesn't use bindless textures
+	uint32 GetTextureSlot(int binding) const;
 
 protected:
-	VkDescriptorSet m_DescriptorSet;
+	std::vector<DescriptorWrite> m_DescriptorWrites;
 	Graphics * m_pGraphics;
 	VkPipeline m_Pipeline;
+	//Built from the regular shaders for bindless materials, used once the bindless texture table is full
+	VkPipeline m_FallbackPipeline = VK_NULL_HANDLE;
+	bool m_PerDrawConstants = false;
+	//Set when the bindless variants of the shaders were loaded and the textures have a slot in the table
+	bool m_Bindless = false;
 	std::vector<std::unique_ptr<Shader>> m_Shaders;
 
 	void GetTypeAndSizeFromString(const std::string& type, VkFormat& format, int& size);
 	VkShaderStageFlagBits GetShaderStageFromString(const std::string& stage);
 
 	std::map<int, std::unique_ptr<Texture2D>> m_Textures;
+	std::map<int, uint32> m_TextureSlots;
+
+	//Returns false and keeps no slots when the table is full
+	bool RegisterTextures();
+	void UnregisterTextures();
 };
\ No newline at end of file
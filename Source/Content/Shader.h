@@ -12,6 +12,6 @@ public:
 
 private:
 	VkDevice m_Device;
-	VkShaderStageFlagBits m_ShaderStage;
-	VkShaderModule m_Module;
+	VkShaderStageFlagBits m_ShaderStage = (VkShaderStageFlagBits)0;
+	VkShaderModule m_Module = VK_NULL_HANDLE;
 };
\ No newline at end of file
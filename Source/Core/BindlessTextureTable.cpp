@@ -0,0 +1,106 @@
+#include "stdafx.h"
+#include "BindlessTextureTable.h"
+#include "Graphics.h"
+#include "DeferredReleaseQueue.h"
+
+BindlessTextureTable::BindlessTextureTable(Graphics* pGraphics, uint32 maxTextures) :
+	m_pGraphics(pGraphics), m_MaxTextures(maxTextures)
+{
+	VkDevice device = pGraphics->GetDevice();
+
+	VkDescriptorSetLayoutBinding binding = {};
+	binding.binding = 0;
+	binding.descriptorCount = maxTextures;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	binding.pImmutableSamplers = nullptr;
+	binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	//Empty slots are never read, filled slots are never written while a frame in flight might read them
+	VkDescriptorBindingFlagsEXT bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsCreateInfo = {};
+	bindingFlagsCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	bindingFlagsCreateInfo.pNext = nullptr;
+	bindingFlagsCreateInfo.bindingCount = 1;
+	bindingFlagsCreateInfo.pBindingFlags = &bindingFlags;
+
+	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {};
+	descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descriptorSetLayoutCreateInfo.pNext = &bindingFlagsCreateInfo;
+	descriptorSetLayoutCreateInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+	descriptorSetLayoutCreateInfo.pBindings = &binding;
+	descriptorSetLayoutCreateInfo.bindingCount = 1;
+	vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCreateInfo, nullptr, &m_Layout);
+
+	VkDescriptorPoolSize poolSize;
+	poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSize.descriptorCount = maxTextures;
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
+	descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolCreateInfo.pNext = nullptr;
+	descriptorPoolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+	descriptorPoolCreateInfo.maxSets = 1;
+	descriptorPoolCreateInfo.poolSizeCount = 1;
+	descriptorPoolCreateInfo.pPoolSizes = &poolSize;
+	vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, nullptr, &m_Pool);
+
+	VkDescriptorSetAllocateInfo descriptorAllocateInfo = {};
+	descriptorAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	descriptorAllocateInfo.pNext = nullptr;
+	descriptorAllocateInfo.descriptorPool = m_Pool;
+	descriptorAllocateInfo.descriptorSetCount = 1;
+	descriptorAllocateInfo.pSetLayouts = &m_Layout;
+	vkAllocateDescriptorSets(device, &descriptorAllocateInfo, &m_Set);
+}
+
+BindlessTextureTable::~BindlessTextureTable()
+{
+	vkDestroyDescriptorPool(m_pGraphics->GetDevice(), m_Pool, nullptr);
+	vkDestroyDescriptorSetLayout(m_pGraphics->GetDevice(), m_Layout, nullptr);
+}
+
+uint32 BindlessTextureTable::Register(VkImageView view, VkSampler sampler)
+{
+	//Writes to the set have to be synchronized as well
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	uint32 slot;
+	if (m_FreeSlots.size() > 0)
+	{
+		slot = m_FreeSlots.back();
+		m_FreeSlots.pop_back();
+	}
+	else if (m_SlotCount < m_MaxTextures)
+	{
+		slot = m_SlotCount++;
+	}
+	else
+	{
+		return INVALID_SLOT;
+	}
+
+	VkDescriptorImageInfo imageInfo;
+	imageInfo.imageView = view;
+	imageInfo.sampler = sampler;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet write = {};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.pNext = nullptr;
+	write.dstSet = m_Set;
+	write.dstBinding = 0;
+	write.dstArrayElement = slot;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.pImageInfo = &imageInfo;
+	vkUpdateDescriptorSets(m_pGraphics->GetDevice(), 1, &write, 0, nullptr);
+	return slot;
+}
+
+void BindlessTextureTable::Unregister(uint32 slot)
+{
+	m_pGraphics->GetReleaseQueue()->Release([this, slot]()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_FreeSlots.push_back(slot);
+	});
+}
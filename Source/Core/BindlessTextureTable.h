@@ -0,0 +1,34 @@
+#pragma once
+class Graphics;
+
+//One descriptor set with an array of every registered texture, bound once for all materials.
+//Shaders index the array with the slot a texture was registered in.
+//Slots are written while the set is bound by frames in flight, so the set uses update after bind
+//and partially bound slots. Unregistered slots are only reused once no frame in flight can sample them.
+class BindlessTextureTable
+{
+public:
+	static const uint32 INVALID_SLOT = ~0u;
+
+	BindlessTextureTable(Graphics* pGraphics, uint32 maxTextures);
+	~BindlessTextureTable();
+
+	//Thread safe. Returns INVALID_SLOT when every slot is taken
+	uint32 Register(VkImageView view, VkSampler sampler);
+	void Unregister(uint32 slot);
+
+	VkDescriptorSetLayout GetLayout() const { return m_Layout; }
+	VkDescriptorSet GetSet() const { return m_Set; }
+	uint32 GetMaxTextures() const { return m_MaxTextures; }
+
+private:
+	Graphics* m_pGraphics;
+	uint32 m_MaxTextures;
+	VkDescriptorSetLayout m_Layout = VK_NULL_HANDLE;
+	VkDescriptorPool m_Pool = VK_NULL_HANDLE;
+	VkDescriptorSet m_Set = VK_NULL_HANDLE;
+
+	std::mutex m_Mutex;
+	std::vector<uint32> m_FreeSlots;
+	uint32 m_SlotCount = 0;
+};
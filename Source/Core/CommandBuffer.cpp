@@ -6,21 +6,21 @@
 #include "Resource/Texture2D.h"
 
 
-CommandBuffer::CommandBuffer(Graphics* pGraphics) :
-	m_pGraphics(pGraphics)
+CommandBuffer::CommandBuffer(Graphics* pGraphics, VkCommandPool commandPool, VkCommandBufferLevel level) :
+	m_pGraphics(pGraphics), m_CommandPool(commandPool != VK_NULL_HANDLE ? commandPool : pGraphics->GetCommandPool())
 {
 	VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
 	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	commandBufferAllocateInfo.commandBufferCount = 1;
-	commandBufferAllocateInfo.commandPool = pGraphics->GetCommandPool();
-	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocateInfo.commandPool = m_CommandPool;
+	commandBufferAllocateInfo.level = level;
 	commandBufferAllocateInfo.pNext = nullptr;
 	vkAllocateCommandBuffers(pGraphics->GetDevice(), &commandBufferAllocateInfo, &m_Buffer);
 }
 
 CommandBuffer::~CommandBuffer()
 {
-	vkFreeCommandBuffers(m_pGraphics->GetDevice(), m_pGraphics->GetCommandPool(), 1, &m_Buffer);
+	vkFreeCommandBuffers(m_pGraphics->GetDevice(), m_CommandPool, 1, &m_Buffer);
 }
 
 void CommandBuffer::Begin()
@@ -32,6 +32,27 @@ void CommandBuffer::Begin()
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
 	vkBeginCommandBuffer(m_Buffer, &beginInfo);
+	ResetState();
+}
+
+void CommandBuffer::BeginSecondary(VkRenderPass renderPass, uint32 subpass, VkFramebuffer frameBuffer)
+{
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.pNext = nullptr;
+	inheritanceInfo.renderPass = renderPass;
+	inheritanceInfo.subpass = subpass;
+	inheritanceInfo.framebuffer = frameBuffer;
+	inheritanceInfo.occlusionQueryEnable = VK_FALSE;
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
+	beginInfo.pNext = nullptr;
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+	vkBeginCommandBuffer(m_Buffer, &beginInfo);
+	ResetState();
 }
 
 void CommandBuffer::End()
@@ -39,7 +60,7 @@ void CommandBuffer::End()
 	vkEndCommandBuffer(m_Buffer);
 }
 
-void CommandBuffer::BeginRenderPass(VkFramebuffer frameBuffer, VkRenderPass renderPass, unsigned int width, unsigned int height)
+void CommandBuffer::BeginRenderPass(VkFramebuffer frameBuffer, VkRenderPass renderPass, unsigned int width, unsigned int height, VkSubpassContents contents)
 {
 	/* We cannot bind the vertex buffer until we begin a renderpass */
 	VkClearValue clearValues[2];
@@ -62,7 +83,7 @@ void CommandBuffer::BeginRenderPass(VkFramebuffer frameBuffer, VkRenderPass rend
 	rpBegin.pClearValues = clearValues;
 	rpBegin.framebuffer = frameBuffer;
 
-	vkCmdBeginRenderPass(m_Buffer, &rpBegin, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBeginRenderPass(m_Buffer, &rpBegin, contents);
 }
 
 void CommandBuffer::EndRenderPass()
@@ -70,30 +91,104 @@ void CommandBuffer::EndRenderPass()
 	vkCmdEndRenderPass(m_Buffer);
 }
 
+void CommandBuffer::ExecuteCommands(const std::vector<CommandBuffer*>& commandBuffers)
+{
+	std::vector<VkCommandBuffer> buffers(commandBuffers.size());
+	for (size_t i = 0; i < commandBuffers.size(); ++i)
+	{
+		buffers[i] = commandBuffers[i]->GetBuffer();
+	}
+	vkCmdExecuteCommands(m_Buffer, (uint32)buffers.size(), buffers.data());
+}
+
 void CommandBuffer::SetGraphicsPipeline(VkPipeline pipeline)
 {
-	vkCmdBindPipeline(m_Buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	if (ChangeState(m_Pipeline != pipeline))
+	{
+		m_Pipeline = pipeline;
+		vkCmdBindPipeline(m_Buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	}
 }
 
 void CommandBuffer::SetViewport(const VkViewport& viewport)
 {
-	vkCmdSetViewport(m_Buffer, 0, 1, &viewport);
+	if (ChangeState(m_HasViewport == false || memcmp(&m_Viewport, &viewport, sizeof(VkViewport)) != 0))
+	{
+		m_HasViewport = true;
+		m_Viewport = viewport;
+		vkCmdSetViewport(m_Buffer, 0, 1, &viewport);
+	}
 }
 
 void CommandBuffer::SetVertexBuffer(int index, VertexBuffer* pVertexBuffer)
 {
-	const VkDeviceSize offsets[1] = { 0 };
-	vkCmdBindVertexBuffers(m_Buffer, index, 1, &pVertexBuffer->GetBuffer(), offsets);
+	VkBuffer buffer = pVertexBuffer->GetBuffer();
+	if (ChangeState(index >= MAX_VERTEX_BUFFERS || m_VertexBuffers[index] != buffer))
+	{
+		if (index < MAX_VERTEX_BUFFERS)
+		{
+			m_VertexBuffers[index] = buffer;
+		}
+		const VkDeviceSize offsets[1] = { 0 };
+		vkCmdBindVertexBuffers(m_Buffer, index, 1, &buffer, offsets);
+	}
 }
 
 void CommandBuffer::SetIndexBuffer(int index, IndexBuffer* pIndexBuffer)
 {
-	vkCmdBindIndexBuffer(m_Buffer, pIndexBuffer->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
+	if (ChangeState(m_IndexBuffer != pIndexBuffer->GetBuffer()))
+	{
+		m_IndexBuffer = pIndexBuffer->GetBuffer();
+		vkCmdBindIndexBuffer(m_Buffer, pIndexBuffer->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
+	}
 }
 
 void CommandBuffer::SetDescriptorSet(VkPipelineLayout pipelineLayout, int setIndex, VkDescriptorSet set, const std::vector<unsigned int>& dynamicOffsets)
 {
-	vkCmdBindDescriptorSets(m_Buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, setIndex, 1, &set, dynamicOffsets.size(), dynamicOffsets.data());
+	if (setIndex >= MAX_DESCRIPTOR_SETS)
+	{
+		ChangeState(true);
+		vkCmdBindDescriptorSets(m_Buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, setIndex, 1, &set, (uint32)dynamicOffsets.size(), dynamicOffsets.data());
+		return;
+	}
+
+	BoundDescriptorSet& bound = m_DescriptorSets[setIndex];
+	if (ChangeState(bound.PipelineLayout != pipelineLayout || bound.Set != set || bound.DynamicOffsets != dynamicOffsets))
+	{
+		//Sets bound with another layout might be disturbed, don't trust any of them anymore
+		if (bound.PipelineLayout != pipelineLayout)
+		{
+			for (BoundDescriptorSet& other : m_DescriptorSets)
+			{
+				other = BoundDescriptorSet();
+			}
+		}
+		bound.PipelineLayout = pipelineLayout;
+		bound.Set = set;
+		bound.DynamicOffsets = dynamicOffsets;
+		vkCmdBindDescriptorSets(m_Buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, setIndex, 1, &set, (uint32)dynamicOffsets.size(), dynamicOffsets.data());
+	}
+}
+
+void CommandBuffer::PushConstants(VkPipelineLayout pipelineLayout, VkShaderStageFlags stages, uint32 offset, uint32 size, const void* pData)
+{
+	assert(offset + size <= MAX_PUSH_CONSTANT_SIZE);
+	bool known = m_PushConstantLayout == pipelineLayout && m_PushConstantStages == stages && offset + size <= m_PushConstantSize;
+	if (ChangeState(known == false || memcmp(m_PushConstants + offset, pData, size) != 0))
+	{
+		if (m_PushConstantLayout != pipelineLayout || m_PushConstantStages != stages)
+		{
+			m_PushConstantLayout = pipelineLayout;
+			m_PushConstantStages = stages;
+			m_PushConstantSize = 0;
+		}
+		memcpy(m_PushConstants + offset, pData, size);
+		if (offset <= m_PushConstantSize)
+		{
+			m_PushConstantSize = std::max(m_PushConstantSize, offset + size);
+		}
+		vkCmdPushConstants(m_Buffer, pipelineLayout, stages, offset, size, pData);
+	}
 }
 
 void CommandBuffer::Draw(unsigned int vertexCount, unsigned int vertexStart)
@@ -101,9 +196,23 @@ void CommandBuffer::Draw(unsigned int vertexCount, unsigned int vertexStart)
 	vkCmdDraw(m_Buffer, vertexCount, 1, vertexStart, 0);
 }
 
-void CommandBuffer::DrawIndexed(unsigned int indexCount, unsigned int indexStart)
+void CommandBuffer::DrawIndexed(unsigned int indexCount, unsigned int indexStart, unsigned int instanceStart)
 {
-	vkCmdDrawIndexed(m_Buffer, indexCount, 1, indexStart, 0, 0);
+	vkCmdDrawIndexed(m_Buffer, indexCount, 1, indexStart, 0, instanceStart);
+}
+
+void CommandBuffer::DrawIndexedIndirect(VkBuffer buffer, VkDeviceSize offset, uint32 drawCount)
+{
+	const uint32 stride = sizeof(VkDrawIndexedIndirectCommand);
+	if (m_pGraphics->GetEnabledFeatures().multiDrawIndirect)
+	{
+		vkCmdDrawIndexedIndirect(m_Buffer, buffer, offset, drawCount, stride);
+		return;
+	}
+	for (uint32 i = 0; i < drawCount; ++i)
+	{
+		vkCmdDrawIndexedIndirect(m_Buffer, buffer, offset + i * stride, 1, stride);
+	}
 }
 
 void CommandBuffer::CopyBufferToImage(VkBuffer buffer, Texture2D* pImage)
@@ -121,9 +230,70 @@ void CommandBuffer::CopyBufferToImage(VkBuffer buffer, Texture2D* pImage)
 	vkCmdCopyBufferToImage(m_Buffer, buffer, (VkImage)pImage->GetImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
 }
 
-void CommandBuffer::CopyBuffer(VkBuffer source, VkBuffer target, int size)
+void CommandBuffer::CopyBuffer(VkBuffer source, VkBuffer target, int size, VkDeviceSize sourceOffset, VkDeviceSize targetOffset)
 {
 	VkBufferCopy copyRegion = {};
+	copyRegion.srcOffset = sourceOffset;
+	copyRegion.dstOffset = targetOffset;
 	copyRegion.size = size;
 	vkCmdCopyBuffer(m_Buffer, source, target, 1, &copyRegion);
 }
+
+void CommandBuffer::CopyImage(VkImage source, VkImage target, VkImageAspectFlags aspectMask, unsigned int width, unsigned int height)
+{
+	VkImageCopy copyRegion = {};
+	copyRegion.srcSubresource.aspectMask = aspectMask;
+	copyRegion.srcSubresource.baseArrayLayer = 0;
+	copyRegion.srcSubresource.layerCount = 1;
+	copyRegion.srcSubresource.mipLevel = 0;
+	copyRegion.dstSubresource = copyRegion.srcSubresource;
+	copyRegion.extent.width = width;
+	copyRegion.extent.height = height;
+	copyRegion.extent.depth = 1;
+
+	vkCmdCopyImage(m_Buffer, source, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, target, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+}
+
+void CommandBuffer::PipelineBarrier(VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage, VkAccessFlags srcAccess, VkAccessFlags dstAccess)
+{
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstAccessMask = dstAccess;
+	vkCmdPipelineBarrier(m_Buffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void CommandBuffer::ResetState()
+{
+	m_Pipeline = VK_NULL_HANDLE;
+	for (VkBuffer& buffer : m_VertexBuffers)
+	{
+		buffer = VK_NULL_HANDLE;
+	}
+	m_IndexBuffer = VK_NULL_HANDLE;
+	for (BoundDescriptorSet& bound : m_DescriptorSets)
+	{
+		bound = BoundDescriptorSet();
+	}
+	m_PushConstantLayout = VK_NULL_HANDLE;
+	m_PushConstantStages = 0;
+	m_PushConstantSize = 0;
+	m_HasViewport = false;
+
+	m_StateChangeCount = 0;
+	m_SkippedStateChangeCount = 0;
+}
+
+bool CommandBuffer::ChangeState(bool changed)
+{
+	if (changed)
+	{
+		++m_StateChangeCount;
+	}
+	else
+	{
+		++m_SkippedStateChangeCount;
+	}
+	return changed;
+}
@@ -4,33 +4,81 @@ class IndexBuffer;
 class VertexBuffer;
 class Texture2D;
 
+//Binds are skipped when the same state is already bound, the state is forgotten at Begin
 class CommandBuffer
 {
 public:
-	CommandBuffer(Graphics* pGraphics);
+	//Allocates from the graphics command pool when no pool is given
+	CommandBuffer(Graphics* pGraphics, VkCommandPool commandPool = VK_NULL_HANDLE, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 	~CommandBuffer();
 
 	void Begin();
+	//Begins a secondary buffer that continues the given subpass, state is not inherited from the primary buffer
+	void BeginSecondary(VkRenderPass renderPass, uint32 subpass, VkFramebuffer frameBuffer);
 	void End();
 
-	void BeginRenderPass(VkFramebuffer frameBuffer, VkRenderPass renderPass, unsigned int width, unsigned int height);
+	//With VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS the pass can only contain ExecuteCommands
+	void BeginRenderPass(VkFramebuffer frameBuffer, VkRenderPass renderPass, unsigned int width, unsigned int height, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
 	void EndRenderPass();
+	void ExecuteCommands(const std::vector<CommandBuffer*>& commandBuffers);
 
 	void SetGraphicsPipeline(VkPipeline pipeline);
 	void SetViewport(const VkViewport& viewport);
 	void SetVertexBuffer(int index, VertexBuffer* pVertexBuffer);
 	void SetIndexBuffer(int index, IndexBuffer* pIndexBuffer);
 	void SetDescriptorSet(VkPipelineLayout pipelineLayout, int setIndex, VkDescriptorSet set, const std::vector<unsigned int>& dynamicOffsets);
+	//Skipped when the range already holds the same values
+	void PushConstants(VkPipelineLayout pipelineLayout, VkShaderStageFlags stages, uint32 offset, uint32 size, const void* pData);
 	void Draw(unsigned int vertexCount, unsigned int vertexStart);
-	void DrawIndexed(unsigned int indexCount, unsigned int indexStart);
+	void DrawIndexed(unsigned int indexCount, unsigned int indexStart, unsigned int instanceStart = 0);
+	//Reads 'drawCount' VkDrawIndexedIndirectCommands, split into single draws without multiDrawIndirect
+	void DrawIndexedIndirect(VkBuffer buffer, VkDeviceSize offset, uint32 drawCount);
 
 	void CopyBufferToImage(VkBuffer buffer, Texture2D* pImage);
-	void CopyBuffer(VkBuffer source, VkBuffer target, int size);
+	void CopyBuffer(VkBuffer source, VkBuffer target, int size, VkDeviceSize sourceOffset = 0, VkDeviceSize targetOffset = 0);
+	void CopyImage(VkImage source, VkImage target, VkImageAspectFlags aspectMask, unsigned int width, unsigned int height);
+
+	void PipelineBarrier(VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage, VkAccessFlags srcAccess, VkAccessFlags dstAccess);
 
 	VkCommandBuffer GetBuffer() const { return m_Buffer; }
 
+	//State changes since Begin that were recorded and that were dropped because they were redundant
+	uint32 GetStateChangeCount() const { return m_StateChangeCount; }
+	uint32 GetSkippedStateChangeCount() const { return m_SkippedStateChangeCount; }
+
 private:
+	static const int MAX_VERTEX_BUFFERS = 4;
+	static const int MAX_DESCRIPTOR_SETS = 4;
+	//The minimum every device supports
+	static const uint32 MAX_PUSH_CONSTANT_SIZE = 128;
+
+	struct BoundDescriptorSet
+	{
+		VkPipelineLayout PipelineLayout = VK_NULL_HANDLE;
+		VkDescriptorSet Set = VK_NULL_HANDLE;
+		std::vector<unsigned int> DynamicOffsets;
+	};
+
+	void ResetState();
+	bool ChangeState(bool changed);
+
 	Graphics * m_pGraphics;
+	VkCommandPool m_CommandPool;
 	VkCommandBuffer m_Buffer;
+
+	VkPipeline m_Pipeline = VK_NULL_HANDLE;
+	VkBuffer m_VertexBuffers[MAX_VERTEX_BUFFERS] = {};
+	VkBuffer m_IndexBuffer = VK_NULL_HANDLE;
+	BoundDescriptorSet m_DescriptorSets[MAX_DESCRIPTOR_SETS];
+	//Only the first 'm_PushConstantSize' bytes are known
+	VkPipelineLayout m_PushConstantLayout = VK_NULL_HANDLE;
+	VkShaderStageFlags m_PushConstantStages = 0;
+	uint32 m_PushConstantSize = 0;
+	uint8 m_PushConstants[MAX_PUSH_CONSTANT_SIZE];
+	bool m_HasViewport = false;
+	VkViewport m_Viewport = {};
+
+	uint32 m_StateChangeCount = 0;
+	uint32 m_SkippedStateChangeCount = 0;
 };
 
@@ -0,0 +1,49 @@
+#include "stdafx.h"
+#include "CommandBufferPool.h"
+#include "Graphics.h"
+#include "CommandBuffer.h"
+#include "Helpers/VulkanHelpers.h"
+
+CommandBufferPool::CommandBufferPool(Graphics* pGraphics, uint32 queueFamilyIndex, VkCommandBufferLevel level) :
+	m_pGraphics(pGraphics), m_Level(level)
+{
+	VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+	commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	commandPoolCreateInfo.pNext = nullptr;
+	commandPoolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+	VK_LOG(vkCreateCommandPool(m_pGraphics->GetDevice(), &commandPoolCreateInfo, nullptr, &m_CommandPool));
+}
+
+CommandBufferPool::~CommandBufferPool()
+{
+	assert(m_AllocatedCount == 0);
+	m_CommandBuffers.clear();
+	vkDestroyCommandPool(m_pGraphics->GetDevice(), m_CommandPool, nullptr);
+}
+
+CommandBuffer* CommandBufferPool::Allocate()
+{
+	++m_AllocatedCount;
+	if (m_FreeCommandBuffers.size() > 0)
+	{
+		CommandBuffer* pCommandBuffer = m_FreeCommandBuffers.back();
+		m_FreeCommandBuffers.pop_back();
+		return pCommandBuffer;
+	}
+	m_CommandBuffers.push_back(std::make_unique<CommandBuffer>(m_pGraphics, m_CommandPool, m_Level));
+	return m_CommandBuffers.back().get();
+}
+
+void CommandBufferPool::Free(CommandBuffer* pCommandBuffer)
+{
+	assert(m_AllocatedCount > 0);
+	--m_AllocatedCount;
+	m_ReturnedCommandBuffers.push_back(pCommandBuffer);
+	if (m_AllocatedCount == 0)
+	{
+		VK_LOG(vkResetCommandPool(m_pGraphics->GetDevice(), m_CommandPool, 0));
+		m_FreeCommandBuffers.insert(m_FreeCommandBuffers.end(), m_ReturnedCommandBuffers.begin(), m_ReturnedCommandBuffers.end());
+		m_ReturnedCommandBuffers.clear();
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+class Graphics;
+class CommandBuffer;
+
+//Hands out command buffers of one level from one command pool.
+//Returned buffers are reset together with one vkResetCommandPool once all of them are back,
+//so a pool is best used for work that retires at the same time, eg. a frame or an upload batch.
+//Not thread safe, every owner keeps its own pool
+class CommandBufferPool
+{
+public:
+	CommandBufferPool(Graphics* pGraphics, uint32 queueFamilyIndex, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+	~CommandBufferPool();
+
+	CommandBuffer* Allocate();
+	//The buffer must not be pending anymore
+	void Free(CommandBuffer* pCommandBuffer);
+
+private:
+	Graphics* m_pGraphics;
+	VkCommandPool m_CommandPool = VK_NULL_HANDLE;
+	VkCommandBufferLevel m_Level;
+
+	std::vector<std::unique_ptr<CommandBuffer>> m_CommandBuffers;
+	std::vector<CommandBuffer*> m_FreeCommandBuffers;
+	std::vector<CommandBuffer*> m_ReturnedCommandBuffers;
+	uint32 m_AllocatedCount = 0;
+};
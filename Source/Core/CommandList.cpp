@@ -0,0 +1,244 @@
+#include "stdafx.h"
+#include "CommandList.h"
+#include "CommandBuffer.h"
+
+namespace
+{
+	struct VertexBufferArguments
+	{
+		int32 Index;
+		VertexBuffer* pVertexBuffer;
+	};
+
+	struct IndexBufferArguments
+	{
+		int32 Index;
+		IndexBuffer* pIndexBuffer;
+	};
+
+	//Followed by the dynamic offsets
+	struct DescriptorSetArguments
+	{
+		VkPipelineLayout PipelineLayout;
+		VkDescriptorSet Set;
+		int32 SetIndex;
+		uint32 DynamicOffsetCount;
+	};
+
+	//Followed by the values
+	struct PushConstantArguments
+	{
+		VkPipelineLayout PipelineLayout;
+		VkShaderStageFlags Stages;
+		uint32 Offset;
+		uint32 Size;
+	};
+
+	struct DrawArguments
+	{
+		uint32 Count;
+		uint32 Start;
+		uint32 InstanceStart;
+	};
+
+	struct DrawIndirectArguments
+	{
+		VkBuffer Buffer;
+		VkDeviceSize Offset;
+		uint32 DrawCount;
+	};
+
+	//Packets are not aligned in the stream
+	template<typename T>
+	T ReadArguments(const uint8* pData)
+	{
+		T arguments;
+		memcpy(&arguments, pData, sizeof(T));
+		return arguments;
+	}
+}
+
+CommandList::CommandList()
+{
+}
+
+CommandList::~CommandList()
+{
+}
+
+void CommandList::Reset()
+{
+	m_Data.clear();
+	m_PacketCount = 0;
+}
+
+void CommandList::SetGraphicsPipeline(VkPipeline pipeline)
+{
+	WriteArguments(PacketType::SetGraphicsPipeline, pipeline);
+}
+
+void CommandList::SetViewport(const VkViewport& viewport)
+{
+	WriteArguments(PacketType::SetViewport, viewport);
+}
+
+void CommandList::SetVertexBuffer(int index, VertexBuffer* pVertexBuffer)
+{
+	VertexBufferArguments arguments;
+	arguments.Index = index;
+	arguments.pVertexBuffer = pVertexBuffer;
+	WriteArguments(PacketType::SetVertexBuffer, arguments);
+}
+
+void CommandList::SetIndexBuffer(int index, IndexBuffer* pIndexBuffer)
+{
+	IndexBufferArguments arguments;
+	arguments.Index = index;
+	arguments.pIndexBuffer = pIndexBuffer;
+	WriteArguments(PacketType::SetIndexBuffer, arguments);
+}
+
+void CommandList::SetDescriptorSet(VkPipelineLayout pipelineLayout, int setIndex, VkDescriptorSet set, const std::vector<unsigned int>& dynamicOffsets)
+{
+	DescriptorSetArguments arguments;
+	arguments.PipelineLayout = pipelineLayout;
+	arguments.Set = set;
+	arguments.SetIndex = setIndex;
+	arguments.DynamicOffsetCount = (uint32)dynamicOffsets.size();
+
+	size_t offsetsSize = dynamicOffsets.size() * sizeof(unsigned int);
+	uint8* pData = (uint8*)WritePacket(PacketType::SetDescriptorSet, sizeof(DescriptorSetArguments) + offsetsSize);
+	memcpy(pData, &arguments, sizeof(DescriptorSetArguments));
+	if (offsetsSize > 0)
+	{
+		memcpy(pData + sizeof(DescriptorSetArguments), dynamicOffsets.data(), offsetsSize);
+	}
+}
+
+void CommandList::PushConstants(VkPipelineLayout pipelineLayout, VkShaderStageFlags stages, uint32 offset, uint32 size, const void* pData)
+{
+	PushConstantArguments arguments;
+	arguments.PipelineLayout = pipelineLayout;
+	arguments.Stages = stages;
+	arguments.Offset = offset;
+	arguments.Size = size;
+
+	uint8* pPacket = (uint8*)WritePacket(PacketType::PushConstants, sizeof(PushConstantArguments) + size);
+	memcpy(pPacket, &arguments, sizeof(PushConstantArguments));
+	memcpy(pPacket + sizeof(PushConstantArguments), pData, size);
+}
+
+void CommandList::Draw(unsigned int vertexCount, unsigned int vertexStart)
+{
+	DrawArguments arguments;
+	arguments.Count = vertexCount;
+	arguments.Start = vertexStart;
+	arguments.InstanceStart = 0;
+	WriteArguments(PacketType::Draw, arguments);
+}
+
+void CommandList::DrawIndexed(unsigned int indexCount, unsigned int indexStart, unsigned int instanceStart)
+{
+	DrawArguments arguments;
+	arguments.Count = indexCount;
+	arguments.Start = indexStart;
+	arguments.InstanceStart = instanceStart;
+	WriteArguments(PacketType::DrawIndexed, arguments);
+}
+
+void CommandList::DrawIndexedIndirect(VkBuffer buffer, VkDeviceSize offset, uint32 drawCount)
+{
+	DrawIndirectArguments arguments;
+	arguments.Buffer = buffer;
+	arguments.Offset = offset;
+	arguments.DrawCount = drawCount;
+	WriteArguments(PacketType::DrawIndexedIndirect, arguments);
+}
+
+void CommandList::Execute(CommandBuffer* pCommandBuffer) const
+{
+	std::vector<unsigned int> dynamicOffsets;
+
+	const uint8* pData = m_Data.data();
+	const uint8* pEnd = pData + m_Data.size();
+	while (pData < pEnd)
+	{
+		PacketHeader header = ReadArguments<PacketHeader>(pData);
+		pData += sizeof(PacketHeader);
+
+		switch (header.Type)
+		{
+		case PacketType::SetGraphicsPipeline:
+			pCommandBuffer->SetGraphicsPipeline(ReadArguments<VkPipeline>(pData));
+			break;
+		case PacketType::SetViewport:
+			pCommandBuffer->SetViewport(ReadArguments<VkViewport>(pData));
+			break;
+		case PacketType::SetVertexBuffer:
+		{
+			VertexBufferArguments arguments = ReadArguments<VertexBufferArguments>(pData);
+			pCommandBuffer->SetVertexBuffer(arguments.Index, arguments.pVertexBuffer);
+			break;
+		}
+		case PacketType::SetIndexBuffer:
+		{
+			IndexBufferArguments arguments = ReadArguments<IndexBufferArguments>(pData);
+			pCommandBuffer->SetIndexBuffer(arguments.Index, arguments.pIndexBuffer);
+			break;
+		}
+		case PacketType::SetDescriptorSet:
+		{
+			DescriptorSetArguments arguments = ReadArguments<DescriptorSetArguments>(pData);
+			dynamicOffsets.resize(arguments.DynamicOffsetCount);
+			if (arguments.DynamicOffsetCount > 0)
+			{
+				memcpy(dynamicOffsets.data(), pData + sizeof(DescriptorSetArguments), arguments.DynamicOffsetCount * sizeof(unsigned int));
+			}
+			pCommandBuffer->SetDescriptorSet(arguments.PipelineLayout, arguments.SetIndex, arguments.Set, dynamicOffsets);
+			break;
+		}
+		case PacketType::PushConstants:
+		{
+			PushConstantArguments arguments = ReadArguments<PushConstantArguments>(pData);
+			pCommandBuffer->PushConstants(arguments.PipelineLayout, arguments.Stages, arguments.Offset, arguments.Size, pData + sizeof(PushConstantArguments));
+			break;
+		}
+		case PacketType::Draw:
+		{
+			DrawArguments arguments = ReadArguments<DrawArguments>(pData);
+			pCommandBuffer->Draw(arguments.Count, arguments.Start);
+			break;
+		}
+		case PacketType::DrawIndexed:
+		{
+			DrawArguments arguments = ReadArguments<DrawArguments>(pData);
+			pCommandBuffer->DrawIndexed(arguments.Count, arguments.Start, arguments.InstanceStart);
+			break;
+		}
+		case PacketType::DrawIndexedIndirect:
+		{
+			DrawIndirectArguments arguments = ReadArguments<DrawIndirectArguments>(pData);
+			pCommandBuffer->DrawIndexedIndirect(arguments.Buffer, arguments.Offset, arguments.DrawCount);
+			break;
+		}
+		default:
+			assert(false);
+			break;
+		}
+		pData += header.Size;
+	}
+}
+
+void* CommandList::WritePacket(PacketType type, size_t size)
+{
+	assert(size <= UINT16_MAX);
+	PacketHeader header;
+	header.Type = type;
+	header.Size = (uint16)size;
+
+	size_t offset = m_Data.size();
+	m_Data.resize(offset + sizeof(PacketHeader) + size);
+	memcpy(&m_Data[offset], &header, sizeof(PacketHeader));
+	++m_PacketCount;
+	return &m_Data[offset + sizeof(PacketHeader)];
+}
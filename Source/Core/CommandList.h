@@ -0,0 +1,66 @@
+#pragma once
+class CommandBuffer;
+class VertexBuffer;
+class IndexBuffer;
+
+//Records binds and draws into a compact byte stream without making any Vulkan calls.
+//A list can be recorded on any thread, kept around, compared or written out and is
+//translated into a CommandBuffer with Execute, which drops redundant binds on the way.
+//Resources are stored by pointer so a kept list stays valid when the Defragmenter moves them.
+class CommandList
+{
+public:
+	enum class PacketType : uint8
+	{
+		SetGraphicsPipeline,
+		SetViewport,
+		SetVertexBuffer,
+		SetIndexBuffer,
+		SetDescriptorSet,
+		PushConstants,
+		Draw,
+		DrawIndexed,
+		DrawIndexedIndirect,
+	};
+
+	CommandList();
+	~CommandList();
+
+	//Forgets the packets but keeps the memory
+	void Reset();
+
+	void SetGraphicsPipeline(VkPipeline pipeline);
+	void SetViewport(const VkViewport& viewport);
+	void SetVertexBuffer(int index, VertexBuffer* pVertexBuffer);
+	void SetIndexBuffer(int index, IndexBuffer* pIndexBuffer);
+	void SetDescriptorSet(VkPipelineLayout pipelineLayout, int setIndex, VkDescriptorSet set, const std::vector<unsigned int>& dynamicOffsets);
+	void PushConstants(VkPipelineLayout pipelineLayout, VkShaderStageFlags stages, uint32 offset, uint32 size, const void* pData);
+	void Draw(unsigned int vertexCount, unsigned int vertexStart);
+	void DrawIndexed(unsigned int indexCount, unsigned int indexStart, unsigned int instanceStart = 0);
+	void DrawIndexedIndirect(VkBuffer buffer, VkDeviceSize offset, uint32 drawCount);
+
+	void Execute(CommandBuffer* pCommandBuffer) const;
+
+	const uint8* GetData() const { return m_Data.data(); }
+	size_t GetSize() const { return m_Data.size(); }
+	uint32 GetPacketCount() const { return m_PacketCount; }
+
+private:
+	//Every packet starts with a header, followed by 'Size' bytes of arguments
+	struct PacketHeader
+	{
+		PacketType Type;
+		uint8 Padding = 0;
+		uint16 Size;
+	};
+
+	void* WritePacket(PacketType type, size_t size);
+	template<typename T>
+	void WriteArguments(PacketType type, const T& arguments)
+	{
+		memcpy(WritePacket(type, sizeof(T)), &arguments, sizeof(T));
+	}
+
+	std::vector<uint8> m_Data;
+	uint32 m_PacketCount = 0;
+};
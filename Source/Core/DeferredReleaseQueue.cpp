@@ -0,0 +1,144 @@
+#include "stdafx.h"
+#include "DeferredReleaseQueue.h"
+#include "Graphics.h"
+
+DeferredReleaseQueue::DeferredReleaseQueue(Graphics* pGraphics) :
+	m_pGraphics(pGraphics)
+{
+}
+
+DeferredReleaseQueue::~DeferredReleaseQueue()
+{
+	Flush();
+}
+
+void DeferredReleaseQueue::Update(uint64 frameIndex, uint64 completedFrameIndex)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_FrameIndex = frameIndex;
+
+	//Objects released during frame N were referenced by frame N at the latest
+	while (m_Objects.size() > 0 && m_Objects.front().FrameIndex <= completedFrameIndex)
+	{
+		Destroy(m_Objects.front());
+		m_Objects.pop_front();
+	}
+}
+
+void DeferredReleaseQueue::Flush()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	for (ReleasedObject& object : m_Objects)
+	{
+		Destroy(object);
+	}
+	m_Objects.clear();
+}
+
+void DeferredReleaseQueue::ReleaseBuffer(VkBuffer buffer)
+{
+	ReleasedObject object;
+	object.Type = VK_OBJECT_TYPE_BUFFER;
+	object.Handle = (uint64)buffer;
+	Push(object);
+}
+
+void DeferredReleaseQueue::ReleaseImage(VkImage image)
+{
+	ReleasedObject object;
+	object.Type = VK_OBJECT_TYPE_IMAGE;
+	object.Handle = (uint64)image;
+	Push(object);
+}
+
+void DeferredReleaseQueue::ReleaseImageView(VkImageView view)
+{
+	ReleasedObject object;
+	object.Type = VK_OBJECT_TYPE_IMAGE_VIEW;
+	object.Handle = (uint64)view;
+	Push(object);
+}
+
+void DeferredReleaseQueue::ReleaseSampler(VkSampler sampler)
+{
+	ReleasedObject object;
+	object.Type = VK_OBJECT_TYPE_SAMPLER;
+	object.Handle = (uint64)sampler;
+	Push(object);
+}
+
+void DeferredReleaseQueue::ReleasePipeline(VkPipeline pipeline)
+{
+	ReleasedObject object;
+	object.Type = VK_OBJECT_TYPE_PIPELINE;
+	object.Handle = (uint64)pipeline;
+	Push(object);
+}
+
+void DeferredReleaseQueue::ReleaseAllocation(const VulkanAllocation& allocation)
+{
+	//The owner is gone, the defragmenter must not try to move the memory in the meantime
+	m_pGraphics->GetAllocator()->SetOwner(allocation, nullptr);
+
+	ReleasedObject object;
+	object.Type = VK_OBJECT_TYPE_DEVICE_MEMORY;
+	object.Allocation = allocation;
+	Push(object);
+}
+
+void DeferredReleaseQueue::Release(const std::function<void()>& release)
+{
+	ReleasedObject object;
+	object.Release = release;
+	Push(object);
+}
+
+void DeferredReleaseQueue::AddReleaseListener(const std::function<void(VkObjectType type, uint64 handle)>& listener)
+{
+	m_Listeners.push_back(listener);
+}
+
+void DeferredReleaseQueue::Push(ReleasedObject& object)
+{
+	//Outside of the lock, listeners may release objects themselves
+	if (object.Handle != 0)
+	{
+		for (const auto& listener : m_Listeners)
+		{
+			listener(object.Type, object.Handle);
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	object.FrameIndex = m_FrameIndex;
+	m_Objects.push_back(std::move(object));
+}
+
+void DeferredReleaseQueue::Destroy(ReleasedObject& object)
+{
+	VkDevice device = m_pGraphics->GetDevice();
+	switch (object.Type)
+	{
+	case VK_OBJECT_TYPE_BUFFER:
+		vkDestroyBuffer(device, (VkBuffer)object.Handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_IMAGE:
+		vkDestroyImage(device, (VkImage)object.Handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_IMAGE_VIEW:
+		vkDestroyImageView(device, (VkImageView)object.Handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_SAMPLER:
+		vkDestroySampler(device, (VkSampler)object.Handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_PIPELINE:
+		vkDestroyPipeline(device, (VkPipeline)object.Handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_DEVICE_MEMORY:
+		m_pGraphics->GetAllocator()->Free(object.Allocation);
+		break;
+	default:
+		object.Release();
+		break;
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "VulkanAllocator.h"
+class Graphics;
+
+//Destroys Vulkan objects and frees their memory once all frames that could still use them have finished.
+//Objects released during frame N are destroyed as soon as the fence of frame N has signaled,
+//so resources can be unloaded mid-session without idling the device.
+class DeferredReleaseQueue
+{
+public:
+	DeferredReleaseQueue(Graphics* pGraphics);
+	~DeferredReleaseQueue();
+
+	//'completedFrameIndex' is the last frame that is known to be finished on the GPU
+	void Update(uint64 frameIndex, uint64 completedFrameIndex);
+	//Releases everything right away, the device has to be idle
+	void Flush();
+
+	void ReleaseBuffer(VkBuffer buffer);
+	void ReleaseImage(VkImage image);
+	void ReleaseImageView(VkImageView view);
+	void ReleaseSampler(VkSampler sampler);
+	void ReleasePipeline(VkPipeline pipeline);
+	//The allocation can't be relocated anymore from here on
+	void ReleaseAllocation(const VulkanAllocation& allocation);
+	//For everything else, eg. returning descriptor sets to their pool
+	void Release(const std::function<void()>& release);
+
+	//Called with the type and handle of every object when it is released, so caches can drop what references it.
+	//Add listeners during initialization, before anything is released
+	void AddReleaseListener(const std::function<void(VkObjectType type, uint64 handle)>& listener);
+
+private:
+	struct ReleasedObject
+	{
+		uint64 FrameIndex = 0;
+		VkObjectType Type = VK_OBJECT_TYPE_UNKNOWN;
+		uint64 Handle = 0;
+		VulkanAllocation Allocation;
+		std::function<void()> Release;
+	};
+
+	void Push(ReleasedObject& object);
+	void Destroy(ReleasedObject& object);
+
+	Graphics* m_pGraphics;
+	std::mutex m_Mutex;
+	uint64 m_FrameIndex = 0;
+	std::deque<ReleasedObject> m_Objects;
+	std::vector<std::function<void(VkObjectType type, uint64 handle)>> m_Listeners;
+};
@@ -0,0 +1,167 @@
+#include "stdafx.h"
+#include "Defragmenter.h"
+#include "Graphics.h"
+#include "CommandBuffer.h"
+#include "VulkanAllocator.h"
+#include "Helpers/VulkanHelpers.h"
+
+Defragmenter::Defragmenter(Graphics* pGraphics) :
+	m_pGraphics(pGraphics)
+{
+	m_pCommandBuffer = std::make_unique<CommandBuffer>(pGraphics);
+
+	VkFenceCreateInfo fenceCreateInfo = {};
+	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceCreateInfo.flags = 0;
+	fenceCreateInfo.pNext = nullptr;
+	VK_LOG(vkCreateFence(m_pGraphics->GetDevice(), &fenceCreateInfo, nullptr, &m_Fence));
+}
+
+Defragmenter::~Defragmenter()
+{
+	if (m_Relocations.size() > 0)
+	{
+		vkWaitForFences(m_pGraphics->GetDevice(), 1, &m_Fence, VK_TRUE, UINT64_MAX);
+		EndPass();
+	}
+	m_pCommandBuffer.reset();
+	vkDestroyFence(m_pGraphics->GetDevice(), m_Fence, nullptr);
+}
+
+void Defragmenter::Update(float budgetMs)
+{
+	if (m_Relocations.size() > 0)
+	{
+		if (vkGetFenceStatus(m_pGraphics->GetDevice(), m_Fence) != VK_SUCCESS)
+		{
+			return;
+		}
+		EndPass();
+	}
+
+	BeginPass(budgetMs);
+}
+
+void Defragmenter::CancelRelocation(RelocatableResource* pResource)
+{
+	auto it = std::find(m_Relocations.begin(), m_Relocations.end(), pResource);
+	if (it != m_Relocations.end())
+	{
+		//The copy might still read from or write to the resource
+		vkWaitForFences(m_pGraphics->GetDevice(), 1, &m_Fence, VK_TRUE, UINT64_MAX);
+		m_Relocations.erase(it);
+	}
+}
+
+MemoryBlock* Defragmenter::FindSparseBlock() const
+{
+	MemoryBlock* pSparsestBlock = nullptr;
+	float lowestRatio = SPARSE_BLOCK_RATIO;
+
+	VulkanAllocator* pAllocator = m_pGraphics->GetAllocator();
+	std::vector<std::pair<RelocatableResource*, VkDeviceSize>> owners;
+	for (const auto& pool : pAllocator->GetMemoryPools())
+	{
+		//Mapped memory can be referenced by CPU pointers, those can't be patched
+		if (pool.second.CpuVisible || pool.second.Blocks.size() < 2)
+		{
+			continue;
+		}
+		for (const auto& pBlock : pool.second.Blocks)
+		{
+			const TLSFAllocator* pBlockAllocator = pBlock->pAllocator.get();
+			if (pBlockAllocator->IsEmpty())
+			{
+				continue;
+			}
+			float ratio = (float)pBlockAllocator->GetUsedSize() / pBlockAllocator->GetSize();
+			if (ratio >= lowestRatio)
+			{
+				continue;
+			}
+
+			//Skip blocks where nothing can be moved
+			owners.clear();
+			pAllocator->GetOwners(pBlock.get(), owners);
+			if (owners.size() > 0)
+			{
+				pSparsestBlock = pBlock.get();
+				lowestRatio = ratio;
+			}
+		}
+	}
+	return pSparsestBlock;
+}
+
+void Defragmenter::BeginPass(float budgetMs)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	//Keeps worker threads from changing the block while its allocations are collected
+	std::lock_guard<std::recursive_mutex> lock(m_pGraphics->GetAllocator()->GetMutex());
+	MemoryBlock* pBlock = FindSparseBlock();
+	if (pBlock == nullptr)
+	{
+		return;
+	}
+
+	//Includes the resources in thread chunks, moving those out lets the chunk return to the block
+	std::vector<std::pair<RelocatableResource*, VkDeviceSize>> owners;
+	m_pGraphics->GetAllocator()->GetOwners(pBlock, owners);
+
+	m_pCommandBuffer->Begin();
+	uint64 movedBytes = 0;
+	for (const auto& owner : owners)
+	{
+		RelocatableResource* pResource = owner.first;
+		RelocationResult result = pResource->BeginRelocation(m_pCommandBuffer.get());
+		if (result == RelocationResult::NoRoom)
+		{
+			//The other blocks are full, moving anything else from this block is pointless
+			break;
+		}
+		if (result == RelocationResult::Busy)
+		{
+			continue;
+		}
+		m_Relocations.push_back(pResource);
+		movedBytes += owner.second;
+
+		float elapsedMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+		if (elapsedMs > budgetMs || movedBytes > MAX_BYTES_PER_PASS)
+		{
+			break;
+		}
+	}
+
+	//Every resource made its copy visible to its usage through the ResourceStateTracker
+	m_pCommandBuffer->End();
+
+	if (m_Relocations.size() == 0)
+	{
+		return;
+	}
+
+	VkCommandBuffer buffer = m_pCommandBuffer->GetBuffer();
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = nullptr;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &buffer;
+	submitInfo.signalSemaphoreCount = 0;
+	submitInfo.waitSemaphoreCount = 0;
+	vkResetFences(m_pGraphics->GetDevice(), 1, &m_Fence);
+	VK_LOG(vkQueueSubmit(m_pGraphics->GetDeviceQueue(), 1, &submitInfo, m_Fence));
+}
+
+void Defragmenter::EndPass()
+{
+	for (RelocatableResource* pResource : m_Relocations)
+	{
+		if (pResource->EndRelocation())
+		{
+			pResource->NotifyRelocated();
+		}
+	}
+	m_Relocations.clear();
+}
@@ -0,0 +1,84 @@
+#pragma once
+class Graphics;
+class CommandBuffer;
+class Defragmenter;
+struct MemoryBlock;
+
+enum class RelocationResult
+{
+	Started,
+	//The other blocks have no room for the resource
+	NoRoom,
+	//The resource has uploads that haven't finished on the GPU, it is moved in a later pass
+	Busy,
+};
+
+//Implemented by resources whose memory can be moved by the Defragmenter
+class RelocatableResource
+{
+public:
+	virtual ~RelocatableResource() {}
+
+	//Creates a copy of the resource in another block and records the copy
+	virtual RelocationResult BeginRelocation(CommandBuffer* pCommandBuffer) = 0;
+	//Called once the copy has finished on the GPU. Switches to the copy and releases the old resource through the DeferredReleaseQueue.
+	//Returns false when the resource was written during the move, the copy is stale then and is released instead
+	virtual bool EndRelocation() = 0;
+
+	//Called after the resource has switched to its copy, so everything that holds its handles can refresh them.
+	//Listeners are added on the thread that updates the Defragmenter and have to outlive the resource
+	void AddRelocationListener(const std::function<void()>& listener) { m_RelocationListeners.push_back(listener); }
+	void NotifyRelocated() const
+	{
+		for (const auto& listener : m_RelocationListeners)
+		{
+			listener();
+		}
+	}
+
+protected:
+	//Uploads are recorded against the handle that is current when they start, they can come from any thread.
+	//The mutex is never held while recording an upload, that can wait for the thread that updates the Defragmenter
+	std::mutex m_RelocationMutex;
+	uint32 m_PendingUploads = 0;
+	//Token of the last upload, the resource isn't moved before it has finished
+	uint64 m_UploadToken = 0;
+	//Set when an upload starts while a copy is in flight
+	bool m_RelocationDiscarded = false;
+
+private:
+	std::vector<std::function<void()>> m_RelocationListeners;
+};
+
+//Incrementally compacts device local memory.
+//Each pass drains the sparsest block by copying its allocations into other blocks of the same pool,
+//the emptied block is then released by the allocator after its grace period.
+//Copies are submitted on the graphics queue and are never waited on, a pass is finished in a later Update.
+class Defragmenter
+{
+public:
+	Defragmenter(Graphics* pGraphics);
+	~Defragmenter();
+
+	//Finishes the previous pass once its copies are done and starts the next one
+	void Update(float budgetMs);
+
+	//Must be called when a resource is destroyed while it is being moved
+	void CancelRelocation(RelocatableResource* pResource);
+
+private:
+	//Blocks filled less than this are drained
+	static constexpr float SPARSE_BLOCK_RATIO = 0.5f;
+	//Limits the amount of GPU work one pass can add to a frame
+	static const uint64 MAX_BYTES_PER_PASS = 16 * 1024 * 1024;
+
+	MemoryBlock* FindSparseBlock() const;
+	void BeginPass(float budgetMs);
+	void EndPass();
+
+	Graphics* m_pGraphics;
+	std::unique_ptr<CommandBuffer> m_pCommandBuffer;
+	VkFence m_Fence = VK_NULL_HANDLE;
+
+	std::vector<RelocatableResource*> m_Relocations;
+};
@@ -0,0 +1,298 @@
+#include "stdafx.h"
+#include "DescriptorAllocator.h"
+#include "Graphics.h"
+
+namespace
+{
+	//Size of one descriptor in the packed update data
+	size_t GetDescriptorInfoSize(VkDescriptorType type)
+	{
+		switch (type)
+		{
+		case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+		case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+		case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+		case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+			return sizeof(VkDescriptorBufferInfo);
+		case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+		case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+			return sizeof(VkBufferView);
+		default:
+			return sizeof(VkDescriptorImageInfo);
+		}
+	}
+}
+
+DescriptorAllocator::DescriptorAllocator(Graphics* pGraphics, uint32 frameCount) :
+	m_pGraphics(pGraphics)
+{
+	m_FramePools.resize(frameCount);
+}
+
+DescriptorAllocator::~DescriptorAllocator()
+{
+	VkDevice device = m_pGraphics->GetDevice();
+	for (const Pool& pool : m_Pools)
+	{
+		vkDestroyDescriptorPool(device, pool.Handle, nullptr);
+	}
+	for (const FramePools& framePools : m_FramePools)
+	{
+		for (const Pool& pool : framePools.Pools)
+		{
+			vkDestroyDescriptorPool(device, pool.Handle, nullptr);
+		}
+	}
+	for (const auto& layout : m_Layouts)
+	{
+		if (layout.second.UpdateTemplate != VK_NULL_HANDLE)
+		{
+			vkDestroyDescriptorUpdateTemplate(device, layout.second.UpdateTemplate, nullptr);
+		}
+		vkDestroyDescriptorSetLayout(device, layout.first, nullptr);
+	}
+}
+
+VkDescriptorSetLayout DescriptorAllocator::CreateLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+{
+	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {};
+	descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descriptorSetLayoutCreateInfo.pNext = nullptr;
+	descriptorSetLayoutCreateInfo.pBindings = bindings.data();
+	descriptorSetLayoutCreateInfo.bindingCount = (uint32)bindings.size();
+
+	VkDescriptorSetLayout layout;
+	vkCreateDescriptorSetLayout(m_pGraphics->GetDevice(), &descriptorSetLayoutCreateInfo, nullptr, &layout);
+
+	LayoutInfo& info = m_Layouts[layout];
+	std::vector<VkDescriptorSetLayoutBinding> sortedBindings = bindings;
+	std::sort(sortedBindings.begin(), sortedBindings.end(), [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+	for (const VkDescriptorSetLayoutBinding& binding : sortedBindings)
+	{
+		info.DescriptorCounts[binding.descriptorType] += binding.descriptorCount;
+
+		size_t stride = GetDescriptorInfoSize(binding.descriptorType);
+		VkDescriptorUpdateTemplateEntry entry;
+		entry.dstBinding = binding.binding;
+		entry.dstArrayElement = 0;
+		entry.descriptorCount = binding.descriptorCount;
+		entry.descriptorType = binding.descriptorType;
+		entry.offset = info.UpdateSize;
+		entry.stride = stride;
+		info.UpdateEntries.push_back(entry);
+		info.UpdateSize += (uint32)(stride * binding.descriptorCount);
+	}
+
+	if (m_pGraphics->GetDeviceProperties().apiVersion >= VK_API_VERSION_1_1)
+	{
+		VkDescriptorUpdateTemplateCreateInfo templateCreateInfo = {};
+		templateCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+		templateCreateInfo.pNext = nullptr;
+		templateCreateInfo.flags = 0;
+		templateCreateInfo.descriptorUpdateEntryCount = (uint32)info.UpdateEntries.size();
+		templateCreateInfo.pDescriptorUpdateEntries = info.UpdateEntries.data();
+		templateCreateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+		templateCreateInfo.descriptorSetLayout = layout;
+		vkCreateDescriptorUpdateTemplate(m_pGraphics->GetDevice(), &templateCreateInfo, nullptr, &info.UpdateTemplate);
+	}
+	return layout;
+}
+
+VkDescriptorSet DescriptorAllocator::Allocate(VkDescriptorSetLayout layout)
+{
+	SetInfo info;
+	info.Layout = layout;
+	VkDescriptorSet set = Allocate(layout, false, info.Pool);
+	m_SetPools[set] = info;
+	return set;
+}
+
+void DescriptorAllocator::Free(VkDescriptorSet set)
+{
+	auto it = m_SetPools.find(set);
+	assert(it != m_SetPools.end());
+	vkFreeDescriptorSets(m_pGraphics->GetDevice(), it->second.Pool, 1, &set);
+	UpdateCounts(it->second.Layout, false);
+	m_SetPools.erase(it);
+}
+
+VkDescriptorSet DescriptorAllocator::AllocateTransient(VkDescriptorSetLayout layout)
+{
+	VkDescriptorPool pool;
+	VkDescriptorSet set = Allocate(layout, true, pool);
+	m_FramePools[m_FrameIndex].Layouts.push_back(layout);
+	return set;
+}
+
+void DescriptorAllocator::BeginFrame(uint32 frameIndex)
+{
+	m_FrameIndex = frameIndex;
+	FramePools& framePools = m_FramePools[frameIndex];
+	for (size_t i = 0; i <= framePools.Current && i < framePools.Pools.size(); ++i)
+	{
+		vkResetDescriptorPool(m_pGraphics->GetDevice(), framePools.Pools[i].Handle, 0);
+	}
+	framePools.Current = 0;
+	for (VkDescriptorSetLayout layout : framePools.Layouts)
+	{
+		UpdateCounts(layout, false);
+	}
+	framePools.Layouts.clear();
+}
+
+void DescriptorAllocator::UpdateSet(VkDescriptorSet set, VkDescriptorSetLayout layout, const void* pData)
+{
+	auto it = m_Layouts.find(layout);
+	assert(it != m_Layouts.end());
+	const LayoutInfo& info = it->second;
+	if (info.UpdateTemplate != VK_NULL_HANDLE)
+	{
+		vkUpdateDescriptorSetWithTemplate(m_pGraphics->GetDevice(), set, info.UpdateTemplate, pData);
+		return;
+	}
+
+	std::vector<VkWriteDescriptorSet> writes;
+	for (const VkDescriptorUpdateTemplateEntry& entry : info.UpdateEntries)
+	{
+		const uint8* pEntryData = (const uint8*)pData + entry.offset;
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.pNext = nullptr;
+		write.dstSet = set;
+		write.dstBinding = entry.dstBinding;
+		write.dstArrayElement = entry.dstArrayElement;
+		write.descriptorCount = entry.descriptorCount;
+		write.descriptorType = entry.descriptorType;
+		//Only the pointer that matches the type is read
+		write.pImageInfo = (const VkDescriptorImageInfo*)pEntryData;
+		write.pBufferInfo = (const VkDescriptorBufferInfo*)pEntryData;
+		write.pTexelBufferView = (const VkBufferView*)pEntryData;
+		writes.push_back(write);
+	}
+	vkUpdateDescriptorSets(m_pGraphics->GetDevice(), (uint32)writes.size(), writes.data(), 0, nullptr);
+}
+
+uint32 DescriptorAllocator::GetUpdateSize(VkDescriptorSetLayout layout) const
+{
+	auto it = m_Layouts.find(layout);
+	assert(it != m_Layouts.end());
+	return it->second.UpdateSize;
+}
+
+uint32 DescriptorAllocator::GetUpdateOffset(VkDescriptorSetLayout layout, uint32 binding) const
+{
+	auto it = m_Layouts.find(layout);
+	assert(it != m_Layouts.end());
+	for (const VkDescriptorUpdateTemplateEntry& entry : it->second.UpdateEntries)
+	{
+		if (entry.dstBinding == binding)
+		{
+			return (uint32)entry.offset;
+		}
+	}
+	assert(false);
+	return 0;
+}
+
+VkDescriptorSet DescriptorAllocator::Allocate(VkDescriptorSetLayout layout, bool transient, VkDescriptorPool& pool)
+{
+	auto layoutIt = m_Layouts.find(layout);
+	assert(layoutIt != m_Layouts.end());
+	UpdateCounts(layout, true);
+
+	//Persistent sets can be freed from any pool, so every pool is tried before a new one is made
+	std::vector<Pool>& pools = transient ? m_FramePools[m_FrameIndex].Pools : m_Pools;
+	size_t first = transient ? m_FramePools[m_FrameIndex].Current : 0;
+	VkDescriptorSet set;
+	for (size_t i = first; i < pools.size(); ++i)
+	{
+		if (TryAllocate(pools[i].Handle, layout, set))
+		{
+			if (transient)
+			{
+				m_FramePools[m_FrameIndex].Current = i;
+			}
+			pool = pools[i].Handle;
+			return set;
+		}
+	}
+
+	uint32 maxSets = pools.empty() ? MIN_SETS_PER_POOL : std::min(pools.back().MaxSets * 2, MAX_SETS_PER_POOL);
+	pools.push_back(CreatePool(maxSets, transient == false, layoutIt->second.DescriptorCounts));
+	if (transient)
+	{
+		m_FramePools[m_FrameIndex].Current = pools.size() - 1;
+	}
+	pool = pools.back().Handle;
+	bool allocated = TryAllocate(pool, layout, set);
+	assert(allocated);
+	return set;
+}
+
+bool DescriptorAllocator::TryAllocate(VkDescriptorPool pool, VkDescriptorSetLayout layout, VkDescriptorSet& set)
+{
+	VkDescriptorSetAllocateInfo descriptorAllocateInfo = {};
+	descriptorAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	descriptorAllocateInfo.descriptorPool = pool;
+	descriptorAllocateInfo.descriptorSetCount = 1;
+	descriptorAllocateInfo.pNext = nullptr;
+	descriptorAllocateInfo.pSetLayouts = &layout;
+	VkResult result = vkAllocateDescriptorSets(m_pGraphics->GetDevice(), &descriptorAllocateInfo, &set);
+	assert(result == VK_SUCCESS || result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL);
+	return result == VK_SUCCESS;
+}
+
+void DescriptorAllocator::UpdateCounts(VkDescriptorSetLayout layout, bool allocated)
+{
+	const LayoutInfo& info = m_Layouts[layout];
+	for (const auto& count : info.DescriptorCounts)
+	{
+		if (allocated)
+		{
+			m_DescriptorCounts[count.first] += count.second;
+		}
+		else
+		{
+			m_DescriptorCounts[count.first] -= count.second;
+		}
+	}
+	if (allocated)
+	{
+		++m_SetCount;
+	}
+	else
+	{
+		--m_SetCount;
+	}
+}
+
+DescriptorAllocator::Pool DescriptorAllocator::CreatePool(uint32 maxSets, bool freeable, const std::map<VkDescriptorType, uint32>& required)
+{
+	//Every type gets its share of the descriptors per set seen so far
+	std::vector<VkDescriptorPoolSize> descriptorPoolSizes;
+	for (const auto& count : m_DescriptorCounts)
+	{
+		VkDescriptorPoolSize poolSize;
+		poolSize.type = count.first;
+		poolSize.descriptorCount = (uint32)std::max<uint64>((count.second * maxSets + m_SetCount - 1) / m_SetCount, 1);
+		auto it = required.find(count.first);
+		if (it != required.end())
+		{
+			poolSize.descriptorCount = std::max(poolSize.descriptorCount, it->second);
+		}
+		descriptorPoolSizes.push_back(poolSize);
+	}
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
+	descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolCreateInfo.flags = freeable ? VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT : 0;
+	descriptorPoolCreateInfo.maxSets = maxSets;
+	descriptorPoolCreateInfo.pNext = nullptr;
+	descriptorPoolCreateInfo.poolSizeCount = (uint32)descriptorPoolSizes.size();
+	descriptorPoolCreateInfo.pPoolSizes = descriptorPoolSizes.data();
+
+	Pool pool;
+	pool.MaxSets = maxSets;
+	vkCreateDescriptorPool(m_pGraphics->GetDevice(), &descriptorPoolCreateInfo, nullptr, &pool.Handle);
+	return pool;
+}
@@ -0,0 +1,94 @@
+#pragma once
+class Graphics;
+
+//Hands out descriptor sets from a growing list of pools.
+//Layouts are created here so the pools can be sized from the descriptors the allocated sets actually use,
+//a full pool is left behind and a larger one is created.
+//Persistent sets are freed one by one, transient sets live for one frame and their pools are reset at once.
+//Every layout gets an update template that writes all of its bindings from one packed struct.
+//Not thread safe.
+class DescriptorAllocator
+{
+public:
+	DescriptorAllocator(Graphics* pGraphics, uint32 frameCount);
+	~DescriptorAllocator();
+
+	//The layout is owned by the allocator
+	VkDescriptorSetLayout CreateLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+
+	VkDescriptorSet Allocate(VkDescriptorSetLayout layout);
+	void Free(VkDescriptorSet set);
+
+	//Valid until the frame with the same index begins again
+	VkDescriptorSet AllocateTransient(VkDescriptorSetLayout layout);
+	//Resets the transient pools of the frame, call once its fence has been waited on
+	void BeginFrame(uint32 frameIndex);
+
+	//The packed data has the descriptors of every binding in binding order, each one a VkDescriptorImageInfo,
+	//VkDescriptorBufferInfo or VkBufferView depending on its type. All bindings are written
+	void UpdateSet(VkDescriptorSet set, VkDescriptorSetLayout layout, const void* pData);
+	//'data' is a struct laid out like the packed data
+	template<typename T>
+	void UpdateSetFromStruct(VkDescriptorSet set, VkDescriptorSetLayout layout, const T& data)
+	{
+		assert(sizeof(T) == GetUpdateSize(layout));
+		UpdateSet(set, layout, (const void*)&data);
+	}
+	uint32 GetUpdateSize(VkDescriptorSetLayout layout) const;
+	uint32 GetUpdateOffset(VkDescriptorSetLayout layout, uint32 binding) const;
+
+private:
+	static const uint32 MIN_SETS_PER_POOL = 64;
+	static const uint32 MAX_SETS_PER_POOL = 4096;
+
+	struct Pool
+	{
+		VkDescriptorPool Handle;
+		uint32 MaxSets;
+	};
+
+	struct LayoutInfo
+	{
+		std::map<VkDescriptorType, uint32> DescriptorCounts;
+		//Null on devices without Vulkan 1.1, the entries are turned into writes there
+		VkDescriptorUpdateTemplate UpdateTemplate = VK_NULL_HANDLE;
+		std::vector<VkDescriptorUpdateTemplateEntry> UpdateEntries;
+		uint32 UpdateSize = 0;
+	};
+
+	struct FramePools
+	{
+		std::vector<Pool> Pools;
+		//Pools before this one are full
+		size_t Current = 0;
+		//Layouts of the sets allocated this frame, their descriptors are taken off the totals on reset
+		std::vector<VkDescriptorSetLayout> Layouts;
+	};
+
+	struct SetInfo
+	{
+		VkDescriptorPool Pool;
+		VkDescriptorSetLayout Layout;
+	};
+
+	VkDescriptorSet Allocate(VkDescriptorSetLayout layout, bool transient, VkDescriptorPool& pool);
+	//Returns false when the pool is out of memory
+	bool TryAllocate(VkDescriptorPool pool, VkDescriptorSetLayout layout, VkDescriptorSet& set);
+	//Adds or removes the descriptors of a set from the totals
+	void UpdateCounts(VkDescriptorSetLayout layout, bool allocated);
+	//'required' are the descriptors of the set that didn't fit anywhere else
+	Pool CreatePool(uint32 maxSets, bool freeable, const std::map<VkDescriptorType, uint32>& required);
+
+	Graphics* m_pGraphics;
+
+	//Descriptors per type in every layout, and the totals of all sets that are currently allocated
+	std::map<VkDescriptorSetLayout, LayoutInfo> m_Layouts;
+	std::map<VkDescriptorType, uint64> m_DescriptorCounts;
+	uint64 m_SetCount = 0;
+
+	std::vector<Pool> m_Pools;
+	std::map<VkDescriptorSet, SetInfo> m_SetPools;
+
+	std::vector<FramePools> m_FramePools;
+	uint32 m_FrameIndex = 0;
+};
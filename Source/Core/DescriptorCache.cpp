@@ -0,0 +1,178 @@
+#include "stdafx.h"
+#include "DescriptorCache.h"
+#include "Graphics.h"
+#include "DescriptorAllocator.h"
+#include "DeferredReleaseQueue.h"
+
+namespace
+{
+	//FNV-1a
+	void HashBytes(uint64& hash, const void* pData, size_t size)
+	{
+		const uint8* pBytes = (const uint8*)pData;
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= pBytes[i];
+			hash *= 1099511628211ull;
+		}
+	}
+
+	template<typename T>
+	void HashValue(uint64& hash, const T& value)
+	{
+		HashBytes(hash, &value, sizeof(T));
+	}
+}
+
+bool DescriptorWrite::operator==(const DescriptorWrite& other) const
+{
+	return Binding == other.Binding && Type == other.Type && Buffer == other.Buffer && Offset == other.Offset && Range == other.Range
+		&& View == other.View && Sampler == other.Sampler && Layout == other.Layout;
+}
+
+DescriptorCache::DescriptorCache(Graphics* pGraphics) :
+	m_pGraphics(pGraphics)
+{
+	m_pGraphics->GetReleaseQueue()->AddReleaseListener([this](VkObjectType type, uint64 handle) { Evict(type, handle); });
+}
+
+DescriptorCache::~DescriptorCache()
+{
+	//The sets go away with the pools of the allocator
+}
+
+VkDescriptorSet DescriptorCache::GetSet(VkDescriptorSetLayout layout, const std::vector<DescriptorWrite>& writes)
+{
+	uint64 hash = Hash(layout, writes);
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto range = m_Lookup.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		Entry& entry = *it->second;
+		if (entry.Layout == layout && entry.Writes == writes)
+		{
+			m_Entries.splice(m_Entries.begin(), m_Entries, it->second);
+			entry.LastUsedFrame = m_FrameIndex;
+			++m_HitCount;
+			return entry.Set;
+		}
+	}
+
+	++m_MissCount;
+	Entry entry;
+	entry.Hash = hash;
+	entry.Layout = layout;
+	entry.Writes = writes;
+	entry.Set = CreateSet(layout, writes);
+	entry.LastUsedFrame = m_FrameIndex;
+	m_Entries.push_front(entry);
+	m_Lookup.insert(std::make_pair(hash, m_Entries.begin()));
+	return entry.Set;
+}
+
+void DescriptorCache::Update(uint64 frameIndex)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_FrameIndex = frameIndex;
+
+	while (m_Entries.size() > MAX_CACHED_SETS && m_Entries.back().LastUsedFrame < frameIndex)
+	{
+		Remove(std::prev(m_Entries.end()));
+	}
+}
+
+void DescriptorCache::Evict(VkObjectType type, uint64 handle)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	for (auto entry = m_Entries.begin(); entry != m_Entries.end();)
+	{
+		bool references = false;
+		for (const DescriptorWrite& write : entry->Writes)
+		{
+			if ((type == VK_OBJECT_TYPE_BUFFER && (uint64)write.Buffer == handle)
+				|| (type == VK_OBJECT_TYPE_IMAGE_VIEW && (uint64)write.View == handle)
+				|| (type == VK_OBJECT_TYPE_SAMPLER && (uint64)write.Sampler == handle))
+			{
+				references = true;
+				break;
+			}
+		}
+		if (references)
+		{
+			Remove(entry++);
+		}
+		else
+		{
+			++entry;
+		}
+	}
+}
+
+void DescriptorCache::Remove(std::list<Entry>::iterator entry)
+{
+	auto range = m_Lookup.equal_range(entry->Hash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (it->second == entry)
+		{
+			m_Lookup.erase(it);
+			break;
+		}
+	}
+
+	//Frames in flight might still have the evicted set bound
+	DescriptorAllocator* pAllocator = m_pGraphics->GetDescriptorAllocator();
+	VkDescriptorSet set = entry->Set;
+	m_pGraphics->GetReleaseQueue()->Release([pAllocator, set]() { pAllocator->Free(set); });
+	m_Entries.erase(entry);
+}
+
+uint64 DescriptorCache::Hash(VkDescriptorSetLayout layout, const std::vector<DescriptorWrite>& writes)
+{
+	uint64 hash = 14695981039346656037ull;
+	HashValue(hash, layout);
+	for (const DescriptorWrite& write : writes)
+	{
+		HashValue(hash, write.Binding);
+		HashValue(hash, write.Type);
+		HashValue(hash, write.Buffer);
+		HashValue(hash, write.Offset);
+		HashValue(hash, write.Range);
+		HashValue(hash, write.View);
+		HashValue(hash, write.Sampler);
+		HashValue(hash, write.Layout);
+	}
+	return hash;
+}
+
+VkDescriptorSet DescriptorCache::CreateSet(VkDescriptorSetLayout layout, const std::vector<DescriptorWrite>& writes)
+{
+	DescriptorAllocator* pAllocator = m_pGraphics->GetDescriptorAllocator();
+	VkDescriptorSet set = pAllocator->Allocate(layout);
+
+	//Packed the way the update template of the layout reads it
+	std::vector<uint8> data(pAllocator->GetUpdateSize(layout));
+	for (const DescriptorWrite& write : writes)
+	{
+		uint8* pData = data.data() + pAllocator->GetUpdateOffset(layout, write.Binding);
+		if (write.Buffer != VK_NULL_HANDLE)
+		{
+			VkDescriptorBufferInfo bufferInfo;
+			bufferInfo.buffer = write.Buffer;
+			bufferInfo.offset = write.Offset;
+			bufferInfo.range = write.Range;
+			memcpy(pData, &bufferInfo, sizeof(VkDescriptorBufferInfo));
+		}
+		else
+		{
+			VkDescriptorImageInfo imageInfo;
+			imageInfo.imageView = write.View;
+			imageInfo.sampler = write.Sampler;
+			imageInfo.imageLayout = write.Layout;
+			memcpy(pData, &imageInfo, sizeof(VkDescriptorImageInfo));
+		}
+	}
+	pAllocator->UpdateSet(set, layout, data.data());
+	return set;
+}
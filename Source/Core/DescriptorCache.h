@@ -0,0 +1,70 @@
+#pragma once
+class Graphics;
+
+//A resource written to one binding of a set, the fields that don't apply to the type stay null
+struct DescriptorWrite
+{
+	uint32 Binding = 0;
+	VkDescriptorType Type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	VkBuffer Buffer = VK_NULL_HANDLE;
+	VkDeviceSize Offset = 0;
+	VkDeviceSize Range = 0;
+	VkImageView View = VK_NULL_HANDLE;
+	VkSampler Sampler = VK_NULL_HANDLE;
+	VkImageLayout Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	bool operator==(const DescriptorWrite& other) const;
+};
+
+//Shares descriptor sets between everything that binds the same resources with the same layout.
+//Sets are looked up by a hash of the layout and the writes, a miss allocates and writes a new set.
+//The writes have to cover every binding of the layout.
+//Sets are only valid for the frame they were requested in, ask for them again every frame.
+//When there are more than MAX_CACHED_SETS, the least recently used sets that weren't used this frame are released.
+//Sets that reference a buffer, image view or sampler are released with it, so a recycled handle never hits a stale set.
+class DescriptorCache
+{
+public:
+	DescriptorCache(Graphics* pGraphics);
+	~DescriptorCache();
+
+	//Thread safe, as long as nothing else allocates from the DescriptorAllocator at the same time
+	VkDescriptorSet GetSet(VkDescriptorSetLayout layout, const std::vector<DescriptorWrite>& writes);
+	//Evicts sets that are over the limit, call at the start of the frame
+	void Update(uint64 frameIndex);
+
+	uint32 GetSetCount() const { return (uint32)m_Entries.size(); }
+	uint64 GetHitCount() const { return m_HitCount; }
+	uint64 GetMissCount() const { return m_MissCount; }
+
+private:
+	static const size_t MAX_CACHED_SETS = 1024;
+
+	struct Entry
+	{
+		uint64 Hash;
+		VkDescriptorSetLayout Layout;
+		std::vector<DescriptorWrite> Writes;
+		VkDescriptorSet Set;
+		uint64 LastUsedFrame;
+	};
+
+	//Releases every set that references the handle
+	void Evict(VkObjectType type, uint64 handle);
+	//Removes the entry from the lookup and releases its set once the frames in flight are done with it
+	void Remove(std::list<Entry>::iterator entry);
+
+	static uint64 Hash(VkDescriptorSetLayout layout, const std::vector<DescriptorWrite>& writes);
+	VkDescriptorSet CreateSet(VkDescriptorSetLayout layout, const std::vector<DescriptorWrite>& writes);
+
+	Graphics* m_pGraphics;
+	std::mutex m_Mutex;
+	uint64 m_FrameIndex = 0;
+
+	//Most recently used at the front
+	std::list<Entry> m_Entries;
+	std::unordered_multimap<uint64, std::list<Entry>::iterator> m_Lookup;
+
+	uint64 m_HitCount = 0;
+	uint64 m_MissCount = 0;
+};
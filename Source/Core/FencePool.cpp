@@ -0,0 +1,46 @@
+#include "stdafx.h"
+#include "FencePool.h"
+#include "Graphics.h"
+#include "Helpers/VulkanHelpers.h"
+
+FencePool::FencePool(Graphics* pGraphics) :
+	m_pGraphics(pGraphics)
+{
+}
+
+FencePool::~FencePool()
+{
+	for (VkFence fence : m_Fences)
+	{
+		vkDestroyFence(m_pGraphics->GetDevice(), fence, nullptr);
+	}
+}
+
+VkFence FencePool::Allocate()
+{
+	if (m_FreeFences.empty() && m_ReturnedFences.size() > 0)
+	{
+		VK_LOG(vkResetFences(m_pGraphics->GetDevice(), (uint32)m_ReturnedFences.size(), m_ReturnedFences.data()));
+		m_FreeFences.swap(m_ReturnedFences);
+	}
+	if (m_FreeFences.size() > 0)
+	{
+		VkFence fence = m_FreeFences.back();
+		m_FreeFences.pop_back();
+		return fence;
+	}
+
+	VkFenceCreateInfo fenceCreateInfo = {};
+	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceCreateInfo.flags = 0;
+	fenceCreateInfo.pNext = nullptr;
+	VkFence fence;
+	VK_LOG(vkCreateFence(m_pGraphics->GetDevice(), &fenceCreateInfo, nullptr, &fence));
+	m_Fences.push_back(fence);
+	return fence;
+}
+
+void FencePool::Free(VkFence fence)
+{
+	m_ReturnedFences.push_back(fence);
+}
@@ -0,0 +1,23 @@
+#pragma once
+class Graphics;
+
+//Recycles fences so temporary GPU work doesn't create and destroy them.
+//Returned fences are reset together with one vkResetFences once the free fences run out.
+//Not thread safe, every owner keeps its own pool
+class FencePool
+{
+public:
+	FencePool(Graphics* pGraphics);
+	~FencePool();
+
+	//Returns an unsignaled fence
+	VkFence Allocate();
+	//The fence can be signaled but must not be pending anymore
+	void Free(VkFence fence);
+
+private:
+	Graphics* m_pGraphics;
+	std::vector<VkFence> m_Fences;
+	std::vector<VkFence> m_FreeFences;
+	std::vector<VkFence> m_ReturnedFences;
+};
@@ -3,17 +3,49 @@
 
 #include <SDL_syswm.h>
 #include "Content/Shader.h"
-#include "Resource/UniformBuffer.h"
 #include "Resource/VertexBuffer.h"
 #include "Resource/IndexBuffer.h"
 #include "Resource/Texture2D.h"
 #include "Resource/Drawable.h"
 #include "Content/Material.h"
-#include "DescriptorPool.h"
+#include "DescriptorAllocator.h"
+#include "DescriptorCache.h"
+#include "BindlessTextureTable.h"
 #include "VulkanAllocator.h"
+#include "RingAllocator.h"
+#include "Defragmenter.h"
+#include "TransientAllocator.h"
+#include "UploadManager.h"
+#include "CommandBufferPool.h"
+#include "FencePool.h"
+#include "DeferredReleaseQueue.h"
+#include "ResourceStateTracker.h"
+#include "CommandList.h"
+#include "IndirectDrawBuilder.h"
 #include "Helpers/VulkanHelpers.h"
 #include "Content/CubeMesh.h"
 
+struct ModelBuffer
+{
+	glm::mat4 ModelMatrix;
+	glm::mat4 MvpMatrix;
+	//Slot in the bindless texture table, padded to the std430 array stride
+	uint32 DiffuseTexture;
+	uint32 Padding[3];
+};
+
+//Pushed per draw or per command list, shaders add the instance index to find their object
+struct PerDrawConstants
+{
+	uint32 ObjectIndex;
+};
+
+struct PerFrameData
+{
+	float dt;
+	int frameCount;
+};
+
 Graphics::Graphics()
 {
 }
@@ -35,23 +67,35 @@ void Graphics::Initialize()
 	ConstructWindow();
 	CreateVulkanInstance();
 	CreateDevice(m_Instance);
-	m_pAllocator = new VulkanAllocator(m_PhysicalDevice, m_Device);
+	m_pAllocator = new VulkanAllocator(m_PhysicalDevice, m_Device, IsDeviceExtensionEnabled(VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME), IsDeviceExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME));
+	m_pTransientAllocator = std::make_unique<TransientAllocator>(this);
+	m_pReleaseQueue = std::make_unique<DeferredReleaseQueue>(this);
+	m_pResourceStateTracker = std::make_unique<ResourceStateTracker>(this);
 
 	CreateSwapchain();
 	CreateCommandPool();
+	m_pTempCommandBufferPool = std::make_unique<CommandBufferPool>(this, GetQueueFamilyIndex());
+	m_pFencePool = std::make_unique<FencePool>(this);
 	CreateCommandBuffers();
 	CreateSynchronizationPrimitives();
+	CreateFrameAllocator(FRAME_ALLOCATOR_SIZE);
+	m_pIndirectDraws = std::make_unique<IndirectDrawBuilder>(this);
+	m_pUploadManager = std::make_unique<UploadManager>(this, STAGING_RING_SIZE);
 	CreatePipelineCache();
-	CreateDescriptorPool();
+	CreateDescriptorAllocator();
+	m_pDefragmenter = std::make_unique<Defragmenter>(this);
 	CreateGlobalPipelineLayout();
 	CreateRenderPassAndFrameBuffer();
 
+	//All startup content goes out in a single upload submit
+	m_pUploadManager->BeginBatch();
 	m_pMaterial = std::make_unique<Material>(this);
 	m_pMaterial->Load("Resources/Materials/Default.xml");
 
 #pragma endregion
 
 	m_pMesh = std::make_unique<CubeMesh>(this);
+	m_pUploadManager->EndBatch();
 
 	for (int i = 0; i < 10; ++i)
 	{
@@ -60,93 +104,61 @@ void Graphics::Initialize()
 		m_Drawables.push_back(std::move(pCube));
 	}
 
-	m_pUniformBuffer = new UniformBuffer(this);
-	m_pUniformBuffer->SetSize(sizeof(glm::mat4) * m_Drawables.size(), 100);
-
-	m_pUniformBufferPerFrame = new UniformBuffer(this);
-	m_pUniformBufferPerFrame->SetSize(sizeof(float) + sizeof(int), 1);
-
-	VkDescriptorBufferInfo ubInfo;
-
-	ubInfo = {};
-	ubInfo.buffer = m_pUniformBuffer->GetBuffer();
-	ubInfo.range = VK_WHOLE_SIZE;
-	ubInfo.offset = 0;
-
-	std::vector<VkWriteDescriptorSet> writes;
-	VkWriteDescriptorSet write;
-	write = {};
-	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	write.descriptorCount = 1;
-	write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-	write.dstBinding = (int)DescriptorBinding::ModelMatrices;
-	write.dstSet = m_ObjectDescriptorSet;
-	write.pBufferInfo = &ubInfo;
-	write.pNext = nullptr;
-	write.dstArrayElement = 0;
-	writes.push_back(write);
-
-	VkDescriptorBufferInfo ubInfo2;
-	ubInfo2 = {};
-	ubInfo2.buffer = m_pUniformBufferPerFrame->GetBuffer();
-	ubInfo2.range = VK_WHOLE_SIZE;
-	ubInfo2.offset = 0;
-
-	write = {};
-	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	write.descriptorCount = 1;
-	write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	write.dstBinding = (int)DescriptorBinding::FrameData;
-	write.dstSet = m_FrameDescriptorSet;
-	write.pBufferInfo = &ubInfo2;
-	write.pNext = nullptr;
-	write.dstArrayElement = 0;
-	writes.push_back(write);
-
-	vkUpdateDescriptorSets(m_Device, (uint32)writes.size(), writes.data(), 0, nullptr);
-
-	BuildCommandBuffers();
-
 	Gameloop();
 }
 
-void Graphics::CopyBufferWithStaging(VkBuffer targetBuffer, void* pData)
+void Graphics::CreateFrameAllocator(VkDeviceSize size)
 {
-	VkMemoryRequirements targetBufferRequirements;
-	vkGetBufferMemoryRequirements(m_Device, targetBuffer, &targetBufferRequirements);
-
-	VkBuffer stagingBuffer;
-
-	VkBufferCreateInfo bufferCreateInfo = {};
-	bufferCreateInfo.flags = 0;
-	bufferCreateInfo.pNext = nullptr;
-	bufferCreateInfo.pQueueFamilyIndices = nullptr;
-	bufferCreateInfo.queueFamilyIndexCount = 0;
-	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	bufferCreateInfo.size = targetBufferRequirements.size;
-	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-	vkCreateBuffer(m_Device, &bufferCreateInfo, nullptr, &stagingBuffer);
-
-	VulkanAllocation allocation = m_pAllocator->Allocate(stagingBuffer, true);
-	vkBindBufferMemory(m_Device, stagingBuffer, allocation.Memory, allocation.Offset);
-
-	memcpy(allocation.pCpuPointer, pData, (size_t)targetBufferRequirements.size);
+	m_pFrameAllocator = std::make_unique<RingAllocator>(this, size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+}
 
-	VkBufferCopy copyRegion = {};
-	copyRegion.size = targetBufferRequirements.size;
+void Graphics::AllocateFrameDescriptorSets()
+{
+	//Transient, the pools of this frame are reset once its fence has been waited on
+	m_ObjectDescriptorSet = m_pDescriptorAllocator->AllocateTransient(GetDescriptorSetLayout(DescriptorGroup::Object));
+	m_FrameDescriptorSet = m_pDescriptorAllocator->AllocateTransient(GetDescriptorSetLayout(DescriptorGroup::Frame));
+
+	//Both sets have a single buffer binding, their packed update data is just its buffer info
+	VkDescriptorBufferInfo objectData = {};
+	objectData.buffer = m_pFrameAllocator->GetBuffer();
+	objectData.range = VK_WHOLE_SIZE;
+	objectData.offset = 0;
+	m_pDescriptorAllocator->UpdateSetFromStruct(m_ObjectDescriptorSet, GetDescriptorSetLayout(DescriptorGroup::Object), objectData);
+
+	VkDescriptorBufferInfo frameData = {};
+	frameData.buffer = m_pFrameAllocator->GetBuffer();
+	frameData.range = sizeof(PerFrameData);
+	frameData.offset = 0;
+	m_pDescriptorAllocator->UpdateSetFromStruct(m_FrameDescriptorSet, GetDescriptorSetLayout(DescriptorGroup::Frame), frameData);
+}
 
-	std::unique_ptr<CommandBuffer> copyCmd = GetTempCommandBuffer(true);
-	copyCmd->CopyBuffer(stagingBuffer, targetBuffer, (int)targetBufferRequirements.size);
-	FlushCommandBuffer(copyCmd);
+void Graphics::ReserveFrameData(size_t objectCount)
+{
+	//Object array, indirect arguments and uniforms of one frame, with their worst case alignment padding
+	VkDeviceSize alignment = m_DeviceProperties.limits.minUniformBufferOffsetAlignment;
+	VkDeviceSize frameSize = (objectCount + 1) * sizeof(ModelBuffer) + objectCount * sizeof(VkDrawIndexedIndirectCommand) + sizeof(uint32) + sizeof(PerFrameData) + alignment;
+	//Every swapchain image can have a frame in flight, one more frame covers the space skipped when the ring wraps
+	VkDeviceSize requiredSize = frameSize * (m_FenceFrameIds.size() + 1);
+	VkDeviceSize size = m_pFrameAllocator->GetSize();
+	if (requiredSize <= size)
+	{
+		return;
+	}
+	while (size < requiredSize)
+	{
+		size *= 2;
+	}
 
-	allocation.Free();
-	vkDestroyBuffer(m_Device, stagingBuffer, nullptr);
+	//Frames in flight still read the ring.
+	//Only happens when the scene outgrows the ring so waiting for the device is fine
+	vkDeviceWaitIdle(m_Device);
+	m_pFrameAllocator.reset();
+	CreateFrameAllocator(size);
 }
 
-std::unique_ptr<CommandBuffer> Graphics::GetTempCommandBuffer(const bool begin)
+CommandBuffer* Graphics::GetTempCommandBuffer(const bool begin)
 {
-	std::unique_ptr<CommandBuffer> pBuffer = std::make_unique<CommandBuffer>(this);
+	CommandBuffer* pBuffer = m_pTempCommandBufferPool->Allocate();
 	if (begin)
 	{
 		pBuffer->Begin();
@@ -154,9 +166,9 @@ std::unique_ptr<CommandBuffer> Graphics::GetTempCommandBuffer(const bool begin)
 	return pBuffer;
 }
 
-void Graphics::FlushCommandBuffer(std::unique_ptr<CommandBuffer>& cmdBuffer)
+void Graphics::FlushCommandBuffer(CommandBuffer* pCommandBuffer)
 {
-	VkCommandBuffer buffer = cmdBuffer->GetBuffer();
+	VkCommandBuffer buffer = pCommandBuffer->GetBuffer();
 
 	vkEndCommandBuffer(buffer);
 	VkSubmitInfo submitInfo = {};
@@ -169,18 +181,13 @@ void Graphics::FlushCommandBuffer(std::unique_ptr<CommandBuffer>& cmdBuffer)
 	submitInfo.pWaitSemaphores = nullptr;
 	submitInfo.signalSemaphoreCount = 0;
 	submitInfo.waitSemaphoreCount = 0;
-	
-	VkFenceCreateInfo fenceCreateInfo = {};
-	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceCreateInfo.flags = 0;
-	fenceCreateInfo.pNext = nullptr;
-	VkFence fence;
-	vkCreateFence(m_Device, &fenceCreateInfo, nullptr, &fence);
+
+	VkFence fence = m_pFencePool->Allocate();
 	vkQueueSubmit(m_DeviceQueue, 1, &submitInfo, fence);
 	vkWaitForFences(m_Device, 1, &fence, VK_TRUE, 1000000000);
-	vkDestroyFence(m_Device, fence, nullptr);
+	m_pFencePool->Free(fence);
 
-	cmdBuffer.reset();
+	m_pTempCommandBufferPool->Free(pCommandBuffer);
 }
 
 void Graphics::ConstructWindow()
@@ -254,6 +261,50 @@ void Graphics::CreateDevice(VkInstance instance)
 	vkGetPhysicalDeviceProperties(m_PhysicalDevice, &m_DeviceProperties);
 	VkPhysicalDeviceFeatures deviceFeatures;
 	vkGetPhysicalDeviceFeatures(m_PhysicalDevice, &deviceFeatures);
+	//Indirect draws select their object data with the first instance
+	m_EnabledFeatures.multiDrawIndirect = deviceFeatures.multiDrawIndirect;
+	m_EnabledFeatures.drawIndirectFirstInstance = deviceFeatures.drawIndirectFirstInstance;
+
+	//Before anything asks IsDeviceExtensionSupported
+	unsigned int extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(m_PhysicalDevice, nullptr, &extensionCount, nullptr);
+	m_SupportedDeviceExtensions.resize(extensionCount);
+	vkEnumerateDeviceExtensionProperties(m_PhysicalDevice, nullptr, &extensionCount, m_SupportedDeviceExtensions.data());
+
+	//Bindless textures are indexed per draw and written while earlier frames are still in flight
+	if (m_DeviceProperties.apiVersion >= VK_API_VERSION_1_1 && IsDeviceExtensionSupported(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME))
+	{
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+		indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+		VkPhysicalDeviceFeatures2 features2 = {};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &indexingFeatures;
+		vkGetPhysicalDeviceFeatures2(m_PhysicalDevice, &features2);
+
+		VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties = {};
+		indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+		VkPhysicalDeviceProperties2 properties2 = {};
+		properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties2.pNext = &indexingProperties;
+		vkGetPhysicalDeviceProperties2(m_PhysicalDevice, &properties2);
+
+		if (indexingFeatures.runtimeDescriptorArray && indexingFeatures.descriptorBindingPartiallyBound
+			&& indexingFeatures.descriptorBindingSampledImageUpdateAfterBind && indexingFeatures.descriptorBindingUpdateUnusedWhilePending
+			&& indexingFeatures.shaderSampledImageArrayNonUniformIndexing)
+		{
+			m_DescriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+			m_DescriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+			m_DescriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+			m_DescriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+			m_DescriptorIndexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+			m_DescriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+			m_MaxBindlessTextures = std::min({ MAX_BINDLESS_TEXTURES,
+				indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+				indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+				indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+				indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers });
+		}
+	}
 
 	//Create device
 	unsigned int familyPropertiesCount = 0;
@@ -277,32 +328,62 @@ void Graphics::CreateDevice(VkInstance instance)
 		return;
 	}
 
+	//A transfer-only family is usually backed by a DMA engine that copies alongside rendering
+	m_TransferQueueFamilyIndex = m_QueueFamilyIndex;
+	for (size_t i = 0; i < m_QueueFamilyProperties.size(); ++i)
+	{
+		VkQueueFlags flags = m_QueueFamilyProperties[i].queueFlags;
+		if ((flags & VK_QUEUE_TRANSFER_BIT) && (flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == 0)
+		{
+			m_TransferQueueFamilyIndex = (int)i;
+			break;
+		}
+	}
+
 	float queuePriorities[] = { 1.0f };
-	VkDeviceQueueCreateInfo deviceQueueCreateInfo = {};
-	deviceQueueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-	deviceQueueCreateInfo.flags = 0;
-	deviceQueueCreateInfo.pNext = nullptr;
-	deviceQueueCreateInfo.pQueuePriorities = queuePriorities;
-	deviceQueueCreateInfo.queueFamilyIndex = m_QueueFamilyIndex;
-	deviceQueueCreateInfo.queueCount = 1;
-
-	std::vector<const char*> deviceExtensions;
+	VkDeviceQueueCreateInfo deviceQueueCreateInfos[2] = {};
+	deviceQueueCreateInfos[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+	deviceQueueCreateInfos[0].flags = 0;
+	deviceQueueCreateInfos[0].pNext = nullptr;
+	deviceQueueCreateInfos[0].pQueuePriorities = queuePriorities;
+	deviceQueueCreateInfos[0].queueFamilyIndex = m_QueueFamilyIndex;
+	deviceQueueCreateInfos[0].queueCount = 1;
+	deviceQueueCreateInfos[1] = deviceQueueCreateInfos[0];
+	deviceQueueCreateInfos[1].queueFamilyIndex = m_TransferQueueFamilyIndex;
+
+	std::vector<const char*>& deviceExtensions = m_EnabledDeviceExtensions;
 	deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	if (IsDeviceExtensionSupported(VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME) && IsDeviceExtensionSupported(VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME))
+	{
+		deviceExtensions.push_back(VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME);
+		deviceExtensions.push_back(VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME);
+	}
+	//The budget is queried with vkGetPhysicalDeviceMemoryProperties2 which is core in 1.1
+	if (m_DeviceProperties.apiVersion >= VK_API_VERSION_1_1 && IsDeviceExtensionSupported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+	{
+		deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	}
+	//Its dependency VK_KHR_maintenance3 is core in 1.1
+	if (m_MaxBindlessTextures > 0)
+	{
+		deviceExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+	}
 
 	VkDeviceCreateInfo deviceCreateInfo = {};
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	deviceCreateInfo.flags = 0;
-	deviceCreateInfo.pNext = nullptr;
+	deviceCreateInfo.pNext = m_MaxBindlessTextures > 0 ? &m_DescriptorIndexingFeatures : nullptr;
 	deviceCreateInfo.enabledExtensionCount = (uint32_t)deviceExtensions.size();
 	deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
-	deviceCreateInfo.pEnabledFeatures = nullptr;
+	deviceCreateInfo.pEnabledFeatures = &m_EnabledFeatures;
 	deviceCreateInfo.enabledLayerCount = 0;
 	deviceCreateInfo.ppEnabledLayerNames = nullptr;
-	deviceCreateInfo.queueCreateInfoCount = 1;
-	deviceCreateInfo.pQueueCreateInfos = &deviceQueueCreateInfo;
+	deviceCreateInfo.queueCreateInfoCount = m_TransferQueueFamilyIndex != m_QueueFamilyIndex ? 2 : 1;
+	deviceCreateInfo.pQueueCreateInfos = deviceQueueCreateInfos;
 
 	VK_LOG(vkCreateDevice(m_PhysicalDevice, &deviceCreateInfo, nullptr, &m_Device));
 	vkGetDeviceQueue(m_Device, m_QueueFamilyIndex, 0, &m_DeviceQueue);
+	vkGetDeviceQueue(m_Device, m_TransferQueueFamilyIndex, 0, &m_TransferQueue);
 }
 
 void Graphics::CreateSwapchain()
@@ -415,9 +496,11 @@ void Graphics::CreateSwapchain()
 		m_SwapchainImages[i]->SetSize(m_WindowWidth, m_WindowHeight, VK_FORMAT_B8G8R8A8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, 1, (int64)swapchainImages[i]);
 	}
 
-	//Depthstencil buffer
+	//Depthstencil buffer, only used by the main pass
 	m_pDepthTexture = new Texture2D(this);
+	m_pDepthTexture->SetTransient(m_pTransientAllocator.get(), 0, 0);
 	m_pDepthTexture->SetSize(m_WindowWidth, m_WindowHeight, VK_FORMAT_D32_SFLOAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 1, 0);
+	m_pTransientAllocator->Build();
 }
 
 void Graphics::CreateCommandPool()
@@ -439,6 +522,25 @@ void Graphics::CreateCommandBuffers()
 	{
 		pCommandBuffer = std::make_unique<CommandBuffer>(this);
 	}
+
+	size_t threadCount = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+	m_SecondaryCommandPools.resize(m_SwapchainImages.size());
+	m_SecondaryCommandBuffers.resize(m_SwapchainImages.size());
+	for (auto& pools : m_SecondaryCommandPools)
+	{
+		for (size_t i = 0; i < threadCount; ++i)
+		{
+			pools.push_back(std::make_unique<CommandBufferPool>(this, GetQueueFamilyIndex(), VK_COMMAND_BUFFER_LEVEL_SECONDARY));
+		}
+	}
+	for (size_t i = 0; i < threadCount; ++i)
+	{
+		m_CommandLists.push_back(std::make_unique<CommandList>());
+	}
+	for (size_t i = 1; i < threadCount; ++i)
+	{
+		m_RecordThreads.emplace_back(&Graphics::RecordThread, this, i);
+	}
 }
 
 void Graphics::CreateSynchronizationPrimitives()
@@ -455,15 +557,21 @@ void Graphics::CreateSynchronizationPrimitives()
 	fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 	fenceCreateInfo.pNext = nullptr;
 	m_WaitFences.resize(m_SwapchainImages.size());
+	m_FenceFrameIds.resize(m_SwapchainImages.size());
 	for (VkFence& fence : m_WaitFences)
 	{
 		vkCreateFence(m_Device, &fenceCreateInfo, nullptr, &fence);
 	}
 }
 
-void Graphics::CreateDescriptorPool()
+void Graphics::CreateDescriptorAllocator()
 {
-	m_pDescriptorPool = std::make_unique<DescriptorPool>(this);
+	m_pDescriptorAllocator = std::make_unique<DescriptorAllocator>(this, (uint32)m_SwapchainImages.size());
+	m_pDescriptorCache = std::make_unique<DescriptorCache>(this);
+	if (m_MaxBindlessTextures > 0)
+	{
+		m_pBindlessTextures = std::make_unique<BindlessTextureTable>(this, m_MaxBindlessTextures);
+	}
 }
 
 void Graphics::CreatePipelineCache()
@@ -573,24 +681,12 @@ void Graphics::CreateGlobalPipelineLayout()
 	//PerFrame
 	binding.binding = (int)DescriptorBinding::FrameData;
 	binding.descriptorCount = 1;
-	binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	binding.pImmutableSamplers = nullptr;
 	binding.stageFlags = VkShaderStageFlagBits::VK_SHADER_STAGE_ALL_GRAPHICS;
 	bindings.push_back(binding);
-	binding.binding = 1;
-	binding.descriptorCount = 1;
-	binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	binding.pImmutableSamplers = nullptr;
-	binding.stageFlags = VkShaderStageFlagBits::VK_SHADER_STAGE_FRAGMENT_BIT;
-	bindings.push_back(binding);
-
-	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {};
-	descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	descriptorSetLayoutCreateInfo.pNext = nullptr;
-	descriptorSetLayoutCreateInfo.pBindings = bindings.data();
-	descriptorSetLayoutCreateInfo.bindingCount = bindings.size();
 
-	vkCreateDescriptorSetLayout(m_Device, &descriptorSetLayoutCreateInfo, nullptr, &m_DescriptorSetLayouts[0]);
+	m_DescriptorSetLayouts[0] = m_pDescriptorAllocator->CreateLayout(bindings);
 
 	//PerView
 	bindings.clear();
@@ -601,24 +697,18 @@ void Graphics::CreateGlobalPipelineLayout()
 	binding.stageFlags = VkShaderStageFlagBits::VK_SHADER_STAGE_ALL_GRAPHICS;
 	bindings.push_back(binding);
 
-	descriptorSetLayoutCreateInfo.pBindings = bindings.data();
-	descriptorSetLayoutCreateInfo.bindingCount = bindings.size();
+	m_DescriptorSetLayouts[1] = m_pDescriptorAllocator->CreateLayout(bindings);
 
-	vkCreateDescriptorSetLayout(m_Device, &descriptorSetLayoutCreateInfo, nullptr, &m_DescriptorSetLayouts[1]);
-
-	//PerObject
+	//PerObject, the whole frame allocator indexed by instance
 	bindings.clear();
 	binding.binding = 0;
 	binding.descriptorCount = 1;
-	binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 	binding.pImmutableSamplers = nullptr;
 	binding.stageFlags = VkShaderStageFlagBits::VK_SHADER_STAGE_ALL_GRAPHICS;
 	bindings.push_back(binding);
 
-	descriptorSetLayoutCreateInfo.pBindings = bindings.data();
-	descriptorSetLayoutCreateInfo.bindingCount = bindings.size();
-
-	vkCreateDescriptorSetLayout(m_Device, &descriptorSetLayoutCreateInfo, nullptr, &m_DescriptorSetLayouts[2]);
+	m_DescriptorSetLayouts[2] = m_pDescriptorAllocator->CreateLayout(bindings);
 
 	//PerMaterial
 	bindings.clear();
@@ -629,22 +719,29 @@ void Graphics::CreateGlobalPipelineLayout()
 	binding.stageFlags = VkShaderStageFlagBits::VK_SHADER_STAGE_FRAGMENT_BIT;
 	bindings.push_back(binding);
 
-	descriptorSetLayoutCreateInfo.pBindings = bindings.data();
-	descriptorSetLayoutCreateInfo.bindingCount = bindings.size();
-
-	vkCreateDescriptorSetLayout(m_Device, &descriptorSetLayoutCreateInfo, nullptr, &m_DescriptorSetLayouts[3]);
+	m_DescriptorSetLayouts[3] = m_pDescriptorAllocator->CreateLayout(bindings);
 
 
 	//Create pipeline layout
 	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = VkHelpers::PipelineLayoutDescriptor();
 	pipelineLayoutCreateInfo.setLayoutCount = m_DescriptorSetLayouts.size();
 	pipelineLayoutCreateInfo.pSetLayouts = m_DescriptorSetLayouts.data();
-	pipelineLayoutCreateInfo.pPushConstantRanges = nullptr;
-	pipelineLayoutCreateInfo.pushConstantRangeCount = 0;
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(PerDrawConstants);
+	pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
 	vkCreatePipelineLayout(m_Device, &pipelineLayoutCreateInfo, nullptr, &m_PipelineLayout);
 
-	m_ObjectDescriptorSet = m_pDescriptorPool->Allocate(m_DescriptorSetLayouts[(int)DescriptorGroup::Object]);
-	m_FrameDescriptorSet = m_pDescriptorPool->Allocate(m_DescriptorSetLayouts[(int)DescriptorGroup::Frame]);
+	//With bindless textures every material binds the same table, the other sets stay compatible
+	if (m_pBindlessTextures)
+	{
+		std::vector<VkDescriptorSetLayout> bindlessSetLayouts = m_DescriptorSetLayouts;
+		bindlessSetLayouts[(int)DescriptorGroup::Material] = m_pBindlessTextures->GetLayout();
+		pipelineLayoutCreateInfo.pSetLayouts = bindlessSetLayouts.data();
+		vkCreatePipelineLayout(m_Device, &pipelineLayoutCreateInfo, nullptr, &m_BindlessPipelineLayout);
+	}
 }
 
 void Graphics::Gameloop()
@@ -659,6 +756,32 @@ void Graphics::Gameloop()
 			{
 			case SDL_QUIT:
 				quit = true;
+				break;
+			case SDL_KEYDOWN:
+				if (event.key.keysym.sym == SDLK_F1)
+				{
+					std::ofstream stream("MemoryStatistics.json");
+					m_pAllocator->DumpStatistics(stream);
+					std::cout << "Memory statistics written to MemoryStatistics.json" << std::endl;
+				}
+				else if (event.key.keysym.sym == SDLK_F2)
+				{
+					if (m_pAllocator->IsTracing())
+					{
+						m_pAllocator->EndTrace();
+						std::cout << "Allocation trace written to AllocationTrace.txt" << std::endl;
+					}
+					else
+					{
+						m_pAllocator->BeginTrace("AllocationTrace.txt");
+					}
+				}
+				else if (event.key.keysym.sym == SDLK_F3)
+				{
+					std::cout << "State changes: " << m_StateChangeCount << " recorded, " << m_SkippedStateChangeCount << " skipped" << std::endl;
+					std::cout << "Descriptor cache: " << m_pDescriptorCache->GetSetCount() << " sets, " << m_pDescriptorCache->GetHitCount() << " hits, " << m_pDescriptorCache->GetMissCount() << " misses" << std::endl;
+				}
+				break;
 			}
 		}
 		++m_FrameCount;
@@ -693,13 +816,22 @@ bool Graphics::CheckValidationLayerSupport(const std::vector<const char*>& layer
 	return success;
 }
 
+bool Graphics::IsDeviceExtensionSupported(const char* pName) const
+{
+	auto it = std::find_if(m_SupportedDeviceExtensions.begin(), m_SupportedDeviceExtensions.end(), [pName](const VkExtensionProperties& a) { return strcmp(a.extensionName, pName) == 0; });
+	return it != m_SupportedDeviceExtensions.end();
+}
+
+bool Graphics::IsDeviceExtensionEnabled(const char* pName) const
+{
+	auto it = std::find_if(m_EnabledDeviceExtensions.begin(), m_EnabledDeviceExtensions.end(), [pName](const char* a) { return strcmp(a, pName) == 0; });
+	return it != m_EnabledDeviceExtensions.end();
+}
+
 void Graphics::UpdateUniforms()
 {
-	struct ModelBuffer
-	{
-		glm::mat4 ModelMatrix;
-		glm::mat4 MvpMatrix;
-	} ModelBufferData;
+	VkDeviceSize alignment = m_DeviceProperties.limits.minUniformBufferOffsetAlignment;
+	ModelBuffer ModelBufferData;
 
 	m_ProjectionMatrix = glm::perspective(glm::radians(45.0f), 1240.0f / 720.0f, 0.1f, 100.0f);
 	m_ViewMatrix = glm::lookAt(
@@ -708,6 +840,16 @@ void Graphics::UpdateUniforms()
 		glm::vec3(0, -1, 0)    // Head is up (set to 0,-1,0 to look upside-down)
 	);
 
+	//Aligned to the element size so the array can be indexed from the start of the buffer
+	RingAllocation objectData = m_pFrameAllocator->Allocate(std::max<size_t>(m_Drawables.size(), 1) * sizeof(ModelBuffer), sizeof(ModelBuffer));
+	m_pIndirectDraws->Reset();
+	if (objectData.IsValid() == false)
+	{
+		//Nothing is drawn this frame
+		m_pIndirectDraws->Build();
+		return;
+	}
+	m_FirstObjectIndex = (uint32)(objectData.Offset / sizeof(ModelBuffer));
 	for (size_t i = 0; i < m_Drawables.size(); ++i)
 	{
 		m_Drawables[i]->SetRotation(0.0f, (float)pow(-1, i), 0.0f, (float)m_FrameCount / 50.0f);
@@ -715,22 +857,30 @@ void Graphics::UpdateUniforms()
 
 		ModelBufferData.ModelMatrix = m_Drawables[i]->GetWorldMatrix();
 		ModelBufferData.MvpMatrix = m_ProjectionMatrix * m_ViewMatrix * ModelBufferData.ModelMatrix;
+		ModelBufferData.DiffuseTexture = m_Drawables[i]->GetMaterial()->GetTextureSlot((int)DescriptorBinding::DiffuseTexture);
 
-		m_pUniformBuffer->SetData(0, sizeof(ModelBuffer), &ModelBufferData);
+		memcpy((ModelBuffer*)objectData.pCpuPointer + i, &ModelBufferData, sizeof(ModelBuffer));
+		m_pIndirectDraws->AddDraw(m_Drawables[i]->GetMesh(), (uint32)i);
 	}
-	
-	struct PerFrameData
-	{
-		float dt;
-		int frameCount;
-	} perFrameData;
+	m_pFrameAllocator->Flush(objectData);
+	m_pIndirectDraws->Build();
 
+	PerFrameData perFrameData;
 	perFrameData.dt = 0.016f;
 	perFrameData.frameCount = m_FrameCount;
-	m_pUniformBufferPerFrame->SetData(0, sizeof(float) + sizeof(int), &perFrameData);
+	RingAllocation allocation = m_pFrameAllocator->Allocate(sizeof(PerFrameData), alignment);
+	if (allocation.IsValid() == false)
+	{
+		m_pIndirectDraws->Reset();
+		m_pIndirectDraws->Build();
+		return;
+	}
+	memcpy(allocation.pCpuPointer, &perFrameData, sizeof(PerFrameData));
+	m_pFrameAllocator->Flush(allocation);
+	m_FrameDataOffset = (uint32)allocation.Offset;
 }
 
-void Graphics::BuildCommandBuffers()
+void Graphics::BuildCommandBuffer()
 {
 	VkViewport viewport;
 	viewport.height = (float)m_WindowHeight;
@@ -740,27 +890,140 @@ void Graphics::BuildCommandBuffers()
 	viewport.minDepth = 0.0f;
 	viewport.maxDepth = 1.0f;
 
-	for (size_t i = 0; i < m_CommandBuffers.size(); ++i)
+	//The frame that used these buffers has finished, giving them back resets the pools
+	std::vector<std::unique_ptr<CommandBufferPool>>& pools = m_SecondaryCommandPools[m_CurrentBuffer];
+	std::vector<CommandBuffer*>& secondaryBuffers = m_SecondaryCommandBuffers[m_CurrentBuffer];
+	for (size_t i = 0; i < secondaryBuffers.size(); ++i)
+	{
+		pools[i]->Free(secondaryBuffers[i]);
+	}
+	secondaryBuffers.clear();
+
+	size_t drawCount = m_pIndirectDraws->GetBatches().size();
+	size_t threadCount = std::min(pools.size(), std::max<size_t>((drawCount + MIN_BATCHES_PER_THREAD - 1) / MIN_BATCHES_PER_THREAD, 1));
+	size_t drawsPerThread = (drawCount + threadCount - 1) / threadCount;
+	for (size_t i = 0; i < threadCount; ++i)
+	{
+		secondaryBuffers.push_back(pools[i]->Allocate());
+	}
+
+	//Each thread records its range into a list and translates the list into its secondary buffer
+	auto recordRange = [this, &secondaryBuffers, &viewport, drawCount, drawsPerThread](size_t thread)
+	{
+		size_t first = std::min(thread * drawsPerThread, drawCount);
+		size_t last = std::min(first + drawsPerThread, drawCount);
+		RecordDrawables(m_CommandLists[thread].get(), viewport, first, last);
+
+		CommandBuffer* pSecondaryBuffer = secondaryBuffers[thread];
+		pSecondaryBuffer->BeginSecondary(m_RenderPass, 0, m_FrameBuffers[m_CurrentBuffer]);
+		m_CommandLists[thread]->Execute(pSecondaryBuffer);
+		pSecondaryBuffer->End();
+	};
+
+	//This thread records the first range while the others record the rest
+	{
+		std::lock_guard<std::mutex> lock(m_RecordMutex);
+		m_RecordTask = recordRange;
+		m_RecordThreadCount = threadCount;
+		m_PendingRecordThreads = threadCount - 1;
+		++m_RecordGeneration;
+	}
+	m_RecordStarted.notify_all();
+	recordRange(0);
+	{
+		std::unique_lock<std::mutex> lock(m_RecordMutex);
+		m_RecordFinished.wait(lock, [this]() { return m_PendingRecordThreads == 0; });
+		m_RecordTask = nullptr;
+	}
+
+	m_StateChangeCount = 0;
+	m_SkippedStateChangeCount = 0;
+	for (size_t i = 0; i < threadCount; ++i)
+	{
+		m_StateChangeCount += secondaryBuffers[i]->GetStateChangeCount();
+		m_SkippedStateChangeCount += secondaryBuffers[i]->GetSkippedStateChangeCount();
+	}
+
+	CommandBuffer* pCommandBuffer = m_CommandBuffers[m_CurrentBuffer].get();
+	pCommandBuffer->Begin();
+	pCommandBuffer->BeginRenderPass(m_FrameBuffers[m_CurrentBuffer], m_RenderPass, m_WindowWidth, m_WindowHeight, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+	pCommandBuffer->ExecuteCommands(secondaryBuffers);
+	pCommandBuffer->EndRenderPass();
+	pCommandBuffer->End();
+}
+
+void Graphics::RecordDrawables(CommandList* pCommandList, const VkViewport& viewport, size_t first, size_t last)
+{
+	pCommandList->Reset();
+	pCommandList->SetViewport(viewport);
+	pCommandList->SetGraphicsPipeline(m_pMaterial->GetPipeline());
+
+	VkPipelineLayout pipelineLayout = m_pMaterial->GetPipelineLayout();
+	pCommandList->SetDescriptorSet(pipelineLayout, (int)DescriptorGroup::Frame, m_FrameDescriptorSet, { m_FrameDataOffset });
+
+	pCommandList->SetDescriptorSet(pipelineLayout, (int)DescriptorGroup::Material, m_pMaterial->GetDescriptorSet(), {});
+	pCommandList->SetDescriptorSet(pipelineLayout, (int)DescriptorGroup::Object, m_ObjectDescriptorSet, {});
+
+	//Indirect draws index the objects with their first instance, relative to the start of this frame's array.
+	//Per draw constants give every draw its object directly and draw with instance 0
+	bool perDrawConstants = m_pMaterial->UsesPerDrawConstants() || m_EnabledFeatures.drawIndirectFirstInstance == VK_FALSE;
+	PerDrawConstants constants;
+	constants.ObjectIndex = m_FirstObjectIndex;
+	pCommandList->PushConstants(pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PerDrawConstants), &constants);
+
+	const std::vector<IndirectDrawBuilder::Batch>& batches = m_pIndirectDraws->GetBatches();
+	const std::vector<VkDrawIndexedIndirectCommand>& commands = m_pIndirectDraws->GetCommands();
+	for (size_t j = first; j < last; ++j)
 	{
-		m_CommandBuffers[i]->Begin();
-		m_CommandBuffers[i]->BeginRenderPass(m_FrameBuffers[i], m_RenderPass, m_WindowWidth, m_WindowHeight);
-		m_CommandBuffers[i]->SetViewport(viewport);
-		m_CommandBuffers[i]->SetGraphicsPipeline(m_pMaterial->GetPipeline());
+		const IndirectDrawBuilder::Batch& batch = batches[j];
+		pCommandList->SetVertexBuffer(0, batch.pVertexBuffer);
+		pCommandList->SetIndexBuffer(0, batch.pIndexBuffer);
 
-		m_CommandBuffers[i]->SetDescriptorSet(m_PipelineLayout, (int)DescriptorGroup::Frame, m_FrameDescriptorSet, {});
-		
-		m_CommandBuffers[i]->SetDescriptorSet(m_PipelineLayout, (int)DescriptorGroup::Material, m_pMaterial->GetDescriptorSet(), {});
-		for (size_t j = 0; j < m_Drawables.size(); ++j)
+		if (perDrawConstants == false)
+		{
+			pCommandList->DrawIndexedIndirect(m_pIndirectDraws->GetBuffer(), batch.Offset, batch.DrawCount);
+		}
+		else
 		{
-			m_CommandBuffers[i]->SetVertexBuffer(0, m_Drawables[j]->GetMesh()->GetVertexBuffer());
-			m_CommandBuffers[i]->SetIndexBuffer(0, m_Drawables[j]->GetMesh()->GetIndexBuffer());
+			for (uint32 k = batch.FirstCommand; k < batch.FirstCommand + batch.DrawCount; ++k)
+			{
+				constants.ObjectIndex = m_FirstObjectIndex + commands[k].firstInstance;
+				pCommandList->PushConstants(pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PerDrawConstants), &constants);
+				pCommandList->DrawIndexed(commands[k].indexCount, commands[k].firstIndex);
+			}
+		}
+	}
+}
+
+void Graphics::RecordThread(size_t thread)
+{
+	uint64 generation = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_RecordMutex);
+			m_RecordStarted.wait(lock, [this, generation]() { return m_StopRecordThreads || m_RecordGeneration != generation; });
+			if (m_StopRecordThreads)
+			{
+				break;
+			}
+			generation = m_RecordGeneration;
+			//Small frames don't need every thread
+			if (thread >= m_RecordThreadCount)
+			{
+				continue;
+			}
+		}
+
+		m_RecordTask(thread);
 
-			m_CommandBuffers[i]->SetDescriptorSet(m_PipelineLayout, (int)DescriptorGroup::Object, m_ObjectDescriptorSet, { (unsigned int)m_pUniformBuffer->GetOffset((int)j) });
-			m_CommandBuffers[i]->DrawIndexed(m_Drawables[j]->GetMesh()->GetIndexBuffer()->GetCount(), 0);
+		std::lock_guard<std::mutex> lock(m_RecordMutex);
+		if (--m_PendingRecordThreads == 0)
+		{
+			m_RecordFinished.notify_one();
 		}
-		m_CommandBuffers[i]->EndRenderPass();
-		m_CommandBuffers[i]->End();
 	}
+	m_pAllocator->ReleaseThreadCache();
 }
 
 void Graphics::Draw()
@@ -770,9 +1033,23 @@ void Graphics::Draw()
 
 	vkWaitForFences(m_Device, 1, &m_WaitFences[m_CurrentBuffer], VK_TRUE, UINT64_MAX);
 	vkResetFences(m_Device, 1, &m_WaitFences[m_CurrentBuffer]);
-
+	m_pDescriptorAllocator->BeginFrame(m_CurrentBuffer);
+
+	m_pAllocator->BeginFrame((uint64)m_FrameCount);
+	m_pFrameAllocator->Retire(m_FenceFrameIds[m_CurrentBuffer]);
+	//Submitted ahead of everything that could read the uploaded resources
+	m_pUploadManager->Flush();
+	m_pReleaseQueue->Update((uint64)m_FrameCount, m_FenceFrameIds[m_CurrentBuffer]);
+	m_pDescriptorCache->Update((uint64)m_FrameCount);
+	m_pDefragmenter->Update(DEFRAGMENT_BUDGET_MS);
+
+	ReserveFrameData(m_Drawables.size());
+	AllocateFrameDescriptorSets();
 	UpdateUniforms();
-	m_pUniformBuffer->Flush();
+	m_pFrameAllocator->EndSegment((uint64)m_FrameCount);
+	m_FenceFrameIds[m_CurrentBuffer] = (uint64)m_FrameCount;
+
+	BuildCommandBuffer();
 
 	const VkCommandBuffer commandBuffers[] = { m_CommandBuffers[m_CurrentBuffer]->GetBuffer() };
 	VkPipelineStageFlags pipelineStateFlags = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
@@ -802,17 +1079,39 @@ void Graphics::Draw()
 
 void Graphics::Shutdown()
 {
+	{
+		std::lock_guard<std::mutex> lock(m_RecordMutex);
+		m_StopRecordThreads = true;
+	}
+	m_RecordStarted.notify_all();
+	for (std::thread& thread : m_RecordThreads)
+	{
+		thread.join();
+	}
+	m_RecordThreads.clear();
+
 	m_pMaterial.reset();
 	m_Drawables.clear();
 
 	m_pMesh.reset();
 
-	delete m_pUniformBuffer;
-	delete m_pUniformBufferPerFrame;
-
-	delete m_pAllocator;
+	m_pDefragmenter.reset();
+	m_pUploadManager.reset();
+	m_pTempCommandBufferPool.reset();
+	m_pFencePool.reset();
+	m_pIndirectDraws.reset();
+	m_pFrameAllocator.reset();
 
 	m_CommandBuffers.clear();
+	for (size_t i = 0; i < m_SecondaryCommandBuffers.size(); ++i)
+	{
+		for (size_t j = 0; j < m_SecondaryCommandBuffers[i].size(); ++j)
+		{
+			m_SecondaryCommandPools[i][j]->Free(m_SecondaryCommandBuffers[i][j]);
+		}
+	}
+	m_SecondaryCommandBuffers.clear();
+	m_SecondaryCommandPools.clear();
 
 	vkDestroySemaphore(m_Device, m_PresentCompleteSemaphore, nullptr);
 	vkDestroySemaphore(m_Device, m_RenderCompleteSemaphore, nullptr);
@@ -826,18 +1125,22 @@ void Graphics::Shutdown()
 		delete view;
 	}
 	delete m_pDepthTexture;
+	m_pReleaseQueue.reset();
+	m_pResourceStateTracker.reset();
+	m_pTransientAllocator.reset();
+
+	delete m_pAllocator;
+
 	vkDestroyCommandPool(m_Device, m_CommandPool, nullptr);
 
 	vkDestroyRenderPass(m_Device, m_RenderPass, nullptr);
 	UnloadPipelineCache();
 
 	vkDestroyPipelineLayout(m_Device, m_PipelineLayout, nullptr);
-	for (size_t i = 0; i < m_DescriptorSetLayouts.size(); ++i)
-	{
-		vkDestroyDescriptorSetLayout(m_Device, m_DescriptorSetLayouts[i], nullptr);
-	}
-
-	m_pDescriptorPool.reset();
+	vkDestroyPipelineLayout(m_Device, m_BindlessPipelineLayout, nullptr);
+	m_pDescriptorCache.reset();
+	m_pBindlessTextures.reset();
+	m_pDescriptorAllocator.reset();
 
 	for (size_t i = 0; i < m_FrameBuffers.size() ; i++)
 	{
@@ -848,8 +1151,3 @@ void Graphics::Shutdown()
 	vkDestroyDevice(m_Device, nullptr);
 	vkDestroyInstance(m_Instance, nullptr);
 }
-
-VkDescriptorSet Graphics::GetDestriptorSet(DescriptorGroup group)
-{
-	return m_pDescriptorPool->Allocate(m_DescriptorSetLayouts[(int)group]);
-}
@@ -7,8 +7,20 @@ class IndexBuffer;
 class Texture2D;
 class Drawable;
 class Material;
-class DescriptorPool;
+class DescriptorAllocator;
+class DescriptorCache;
+class BindlessTextureTable;
 class VulkanAllocator;
+class RingAllocator;
+class Defragmenter;
+class TransientAllocator;
+class UploadManager;
+class CommandBufferPool;
+class FencePool;
+class DeferredReleaseQueue;
+class ResourceStateTracker;
+class CommandList;
+class IndirectDrawBuilder;
 class Mesh;
 
 enum class DescriptorGroup
@@ -42,29 +54,44 @@ public:
 
 	void Initialize();
 
-	void CopyBufferWithStaging(VkBuffer targetBuffer, void* pData);
-
-	std::unique_ptr<CommandBuffer> GetTempCommandBuffer(const bool begin);
+	//Temporary command buffers come from a pool, FlushCommandBuffer waits for them and gives them back
+	CommandBuffer* GetTempCommandBuffer(const bool begin);
 	VkRenderPass GetRenderPass() const { return m_RenderPass; }
 
-	void FlushCommandBuffer(std::unique_ptr<CommandBuffer>& cmdBuffer);
+	void FlushCommandBuffer(CommandBuffer* pCommandBuffer);
 
 	VkPipelineCache GetPipelineCache() const { return m_PipelineCache; }
 	const VkPhysicalDeviceProperties& GetDeviceProperties() const { return m_DeviceProperties; };
+	const VkPhysicalDeviceFeatures& GetEnabledFeatures() const { return m_EnabledFeatures; }
 
 	VkCommandPool GetCommandPool() const { return m_CommandPool; }
-	DescriptorPool* GetDescriptorPool() const { return m_pDescriptorPool.get(); }
+	DescriptorAllocator* GetDescriptorAllocator() const { return m_pDescriptorAllocator.get(); }
+	DescriptorCache* GetDescriptorCache() const { return m_pDescriptorCache.get(); }
+	//Null when the device doesn't support descriptor indexing
+	BindlessTextureTable* GetBindlessTextures() const { return m_pBindlessTextures.get(); }
 	VulkanAllocator* GetAllocator() const { return m_pAllocator; }
+	RingAllocator* GetFrameAllocator() const { return m_pFrameAllocator.get(); }
+	Defragmenter* GetDefragmenter() const { return m_pDefragmenter.get(); }
+	DeferredReleaseQueue* GetReleaseQueue() const { return m_pReleaseQueue.get(); }
+	ResourceStateTracker* GetResourceStateTracker() const { return m_pResourceStateTracker.get(); }
+	UploadManager* GetUploadManager() const { return m_pUploadManager.get(); }
 
 	void Shutdown();
 
 	const VkDevice& GetDevice() const { return m_Device; }
+	VkQueue GetDeviceQueue() const { return m_DeviceQueue; }
+	uint32 GetQueueFamilyIndex() const { return (uint32)m_QueueFamilyIndex; }
+	//Same as the graphics queue when the device has no transfer-only queue family
+	VkQueue GetTransferQueue() const { return m_TransferQueue; }
+	uint32 GetTransferQueueFamilyIndex() const { return (uint32)m_TransferQueueFamilyIndex; }
+	bool IsDeviceExtensionEnabled(const char* pName) const;
 
 	int GetBackbufferIndex() const { return (int)m_CurrentBuffer; }
 	int GetBackbufferCount() const { return (int)m_FrameBuffers.size(); }
 
-	VkDescriptorSet GetDestriptorSet(DescriptorGroup group);
-	VkPipelineLayout GetPipelineLayout() const { return m_PipelineLayout; }
+	VkDescriptorSetLayout GetDescriptorSetLayout(DescriptorGroup group) const { return m_DescriptorSetLayouts[(int)group]; }
+	//Bindless materials bind the texture table as their material set
+	VkPipelineLayout GetPipelineLayout(bool bindless = false) const { return bindless ? m_BindlessPipelineLayout : m_PipelineLayout; }
 
 private:
 	void ConstructWindow();
@@ -74,24 +101,57 @@ private:
 	void CreateCommandPool();
 	void CreateCommandBuffers();
 	void CreateSynchronizationPrimitives();
-	void CreateDescriptorPool();
+	void CreateDescriptorAllocator();
 	void CreatePipelineCache();
 	void UnloadPipelineCache();
 	void CreateRenderPassAndFrameBuffer();
 	void CreateGlobalPipelineLayout();
+	void CreateFrameAllocator(VkDeviceSize size);
+	//Allocates the frame and object sets of the current frame and points them at the frame allocator
+	void AllocateFrameDescriptorSets();
 
-	void BuildCommandBuffers();
+	void BuildCommandBuffer();
+	void RecordDrawables(CommandList* pCommandList, const VkViewport& viewport, size_t first, size_t last);
+	void RecordThread(size_t thread);
 
+	//Grows the frame allocator when the frames in flight don't fit the per-frame data of 'objectCount' objects
+	void ReserveFrameData(size_t objectCount);
 	void UpdateUniforms();
 	void Gameloop();
 	void Draw();
 
 	bool CheckValidationLayerSupport(const std::vector<const char*>& layers);
+	bool IsDeviceExtensionSupported(const char* pName) const;
 	HWND GetWindow() const;
 
-	std::unique_ptr<DescriptorPool> m_pDescriptorPool;
+	std::unique_ptr<DescriptorAllocator> m_pDescriptorAllocator;
+	std::unique_ptr<DescriptorCache> m_pDescriptorCache;
+	std::unique_ptr<BindlessTextureTable> m_pBindlessTextures;
 	VulkanAllocator* m_pAllocator;
 
+	//Transient per-frame data, reclaimed when the frame's wait fence has signaled
+	static const VkDeviceSize FRAME_ALLOCATOR_SIZE = 4 * 1024 * 1024;
+	std::unique_ptr<RingAllocator> m_pFrameAllocator;
+	std::vector<uint64> m_FenceFrameIds;
+
+	//Objects that frames in flight might still use are destroyed through this
+	std::unique_ptr<DeferredReleaseQueue> m_pReleaseQueue;
+	std::unique_ptr<ResourceStateTracker> m_pResourceStateTracker;
+
+	//Time per frame spent on moving allocations out of sparse blocks
+	static constexpr float DEFRAGMENT_BUDGET_MS = 0.5f;
+	std::unique_ptr<Defragmenter> m_pDefragmenter;
+
+	//Memory for attachments that only live within a pass
+	std::unique_ptr<TransientAllocator> m_pTransientAllocator;
+
+	//Staging memory for uploads, larger uploads are split into chunks
+	static const VkDeviceSize STAGING_RING_SIZE = 32 * 1024 * 1024;
+	std::unique_ptr<UploadManager> m_pUploadManager;
+
+	std::unique_ptr<CommandBufferPool> m_pTempCommandBufferPool;
+	std::unique_ptr<FencePool> m_pFencePool;
+
 	std::unique_ptr<Material> m_pMaterial;
 
 	VkInstance m_Instance;
@@ -101,11 +161,41 @@ private:
 	int m_QueueFamilyIndex = -1;
 	std::vector<VkQueueFamilyProperties> m_QueueFamilyProperties;
 	VkPhysicalDeviceProperties m_DeviceProperties;
+	VkPhysicalDeviceFeatures m_EnabledFeatures = {};
+	//Chained into the device create info, only enabled when everything the bindless texture table needs is there
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT m_DescriptorIndexingFeatures = {};
+	static const uint32 MAX_BINDLESS_TEXTURES = 4096;
+	uint32 m_MaxBindlessTextures = 0;
+	std::vector<VkExtensionProperties> m_SupportedDeviceExtensions;
+	std::vector<const char*> m_EnabledDeviceExtensions;
 	VkQueue m_DeviceQueue;
+	int m_TransferQueueFamilyIndex = -1;
+	VkQueue m_TransferQueue;
 
 	VkCommandPool m_CommandPool;
 	std::vector<std::unique_ptr<CommandBuffer>> m_CommandBuffers;
 
+	//Drawables are recorded into secondary buffers on up to one thread per core.
+	//Every thread has its own pool per swapchain image, the pools are reset when the image's fence has signaled
+	static const size_t MIN_BATCHES_PER_THREAD = 256;
+	std::vector<std::vector<std::unique_ptr<CommandBufferPool>>> m_SecondaryCommandPools;
+	std::vector<std::vector<CommandBuffer*>> m_SecondaryCommandBuffers;
+	//Every thread first records into its own list, which is then translated into its secondary buffer
+	std::vector<std::unique_ptr<CommandList>> m_CommandLists;
+	//Thread 0 is the main thread, the others are started once and woken up every frame to run the record task
+	std::vector<std::thread> m_RecordThreads;
+	std::mutex m_RecordMutex;
+	std::condition_variable m_RecordStarted;
+	std::condition_variable m_RecordFinished;
+	std::function<void(size_t)> m_RecordTask;
+	uint64 m_RecordGeneration = 0;
+	size_t m_RecordThreadCount = 0;
+	size_t m_PendingRecordThreads = 0;
+	bool m_StopRecordThreads = false;
+	//State changes of the last recorded frame
+	uint32 m_StateChangeCount = 0;
+	uint32 m_SkippedStateChangeCount = 0;
+
 	VkSurfaceKHR m_Surface;
 	VkSwapchainKHR m_SwapChain;
 	VkPipelineCache m_PipelineCache;
@@ -120,6 +210,7 @@ private:
 	VkDescriptorSet m_ObjectDescriptorSet;
 	VkDescriptorSet m_FrameDescriptorSet;
 	VkPipelineLayout m_PipelineLayout;
+	VkPipelineLayout m_BindlessPipelineLayout = VK_NULL_HANDLE;
 	std::vector<VkDescriptorSetLayout> m_DescriptorSetLayouts;
 
 	size_t m_CurrentBuffer = 0;
@@ -130,8 +221,10 @@ private:
 	unsigned int m_WindowWidth = 1240;
 	unsigned int m_WindowHeight = 720;
 
-	UniformBuffer* m_pUniformBuffer = nullptr;
-	UniformBuffer* m_pUniformBufferPerFrame = nullptr;
+	//Object data of all drawables is one array in the frame allocator, drawn with one indirect draw per mesh
+	uint32 m_FirstObjectIndex = 0;
+	std::unique_ptr<IndirectDrawBuilder> m_pIndirectDraws;
+	uint32 m_FrameDataOffset = 0;
 
 	std::unique_ptr<Mesh> m_pMesh;
 	std::vector<std::unique_ptr<Drawable>> m_Drawables;
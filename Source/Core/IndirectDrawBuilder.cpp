@@ -0,0 +1,88 @@
+#include "stdafx.h"
+#include "IndirectDrawBuilder.h"
+#include "Graphics.h"
+#include "RingAllocator.h"
+#include "Content/Mesh.h"
+#include "Resource/IndexBuffer.h"
+
+IndirectDrawBuilder::IndirectDrawBuilder(Graphics* pGraphics) :
+	m_pGraphics(pGraphics)
+{
+}
+
+IndirectDrawBuilder::~IndirectDrawBuilder()
+{
+}
+
+void IndirectDrawBuilder::Reset()
+{
+	m_Draws.clear();
+	m_Commands.clear();
+	m_Batches.clear();
+}
+
+void IndirectDrawBuilder::AddDraw(Mesh* pMesh, uint32 objectIndex)
+{
+	DrawRequest draw;
+	draw.pMesh = pMesh;
+	draw.ObjectIndex = objectIndex;
+	m_Draws.push_back(draw);
+}
+
+void IndirectDrawBuilder::Build()
+{
+	m_Commands.clear();
+	m_Batches.clear();
+	if (m_Draws.empty())
+	{
+		return;
+	}
+
+	//Stable so draws within a group keep the order they were added in
+	std::stable_sort(m_Draws.begin(), m_Draws.end(), [](const DrawRequest& a, const DrawRequest& b)
+	{
+		if (a.pMesh->GetVertexBuffer() != b.pMesh->GetVertexBuffer())
+		{
+			return a.pMesh->GetVertexBuffer() < b.pMesh->GetVertexBuffer();
+		}
+		return a.pMesh->GetIndexBuffer() < b.pMesh->GetIndexBuffer();
+	});
+
+	RingAllocation allocation = m_pGraphics->GetFrameAllocator()->Allocate(m_Draws.size() * sizeof(VkDrawIndexedIndirectCommand), sizeof(uint32));
+	if (allocation.IsValid() == false)
+	{
+		return;
+	}
+	for (const DrawRequest& draw : m_Draws)
+	{
+		VertexBuffer* pVertexBuffer = draw.pMesh->GetVertexBuffer();
+		IndexBuffer* pIndexBuffer = draw.pMesh->GetIndexBuffer();
+		if (m_Batches.empty() || m_Batches.back().pVertexBuffer != pVertexBuffer || m_Batches.back().pIndexBuffer != pIndexBuffer)
+		{
+			Batch batch;
+			batch.pVertexBuffer = pVertexBuffer;
+			batch.pIndexBuffer = pIndexBuffer;
+			batch.Offset = allocation.Offset + m_Commands.size() * sizeof(VkDrawIndexedIndirectCommand);
+			batch.FirstCommand = (uint32)m_Commands.size();
+			batch.DrawCount = 0;
+			m_Batches.push_back(batch);
+		}
+		++m_Batches.back().DrawCount;
+
+		VkDrawIndexedIndirectCommand command;
+		command.indexCount = (uint32)pIndexBuffer->GetCount();
+		command.instanceCount = 1;
+		command.firstIndex = 0;
+		command.vertexOffset = 0;
+		command.firstInstance = draw.ObjectIndex;
+		m_Commands.push_back(command);
+	}
+
+	memcpy(allocation.pCpuPointer, m_Commands.data(), m_Commands.size() * sizeof(VkDrawIndexedIndirectCommand));
+	m_pGraphics->GetFrameAllocator()->Flush(allocation);
+}
+
+VkBuffer IndirectDrawBuilder::GetBuffer() const
+{
+	return m_pGraphics->GetFrameAllocator()->GetBuffer();
+}
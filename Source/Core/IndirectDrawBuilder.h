@@ -0,0 +1,48 @@
+#pragma once
+class Graphics;
+class Mesh;
+class VertexBuffer;
+class IndexBuffer;
+
+//Packs draws into VkDrawIndexedIndirectCommand arrays in the frame allocator.
+//Draws are grouped by their vertex and index buffer so every group can go out as one multi-draw.
+//The first instance of a draw is its object index, shaders add gl_InstanceIndex to the object index in the push constants.
+class IndirectDrawBuilder
+{
+public:
+	//A range of commands that share their buffers
+	struct Batch
+	{
+		VertexBuffer* pVertexBuffer;
+		IndexBuffer* pIndexBuffer;
+		VkDeviceSize Offset;
+		uint32 FirstCommand;
+		uint32 DrawCount;
+	};
+
+	IndirectDrawBuilder(Graphics* pGraphics);
+	~IndirectDrawBuilder();
+
+	void Reset();
+	//Only add drawables that are visible
+	void AddDraw(Mesh* pMesh, uint32 objectIndex);
+	//Must be called before the frame allocator segment of the frame ends
+	void Build();
+
+	VkBuffer GetBuffer() const;
+	const std::vector<Batch>& GetBatches() const { return m_Batches; }
+	//CPU copy of the arguments, for devices that can't draw indirect with a first instance
+	const std::vector<VkDrawIndexedIndirectCommand>& GetCommands() const { return m_Commands; }
+
+private:
+	struct DrawRequest
+	{
+		Mesh* pMesh;
+		uint32 ObjectIndex;
+	};
+
+	Graphics* m_pGraphics;
+	std::vector<DrawRequest> m_Draws;
+	std::vector<VkDrawIndexedIndirectCommand> m_Commands;
+	std::vector<Batch> m_Batches;
+};
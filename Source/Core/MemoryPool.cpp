@@ -0,0 +1,80 @@
+#include "stdafx.h"
+#include "MemoryPool.h"
+
+MemoryBlock* MemoryPool::Allocate(MemoryBackend& backend, const VkMemoryRequirements& requirements, uint64 frameIndex, VkDeviceSize& offset, uint32& handle)
+{
+	for (auto& pBlock : Blocks)
+	{
+		if (pBlock->pAllocator->Allocate(requirements.size, requirements.alignment, offset, handle))
+		{
+			return pBlock.get();
+		}
+	}
+
+	//No block has room, grow the pool. Retry with smaller blocks if the device is running low
+	MemoryBlock* pTargetBlock = nullptr;
+	VkDeviceSize blockSize = std::max(BlockSize, requirements.size);
+	while (pTargetBlock == nullptr)
+	{
+		pTargetBlock = CreateBlock(backend, blockSize, frameIndex);
+		if (pTargetBlock == nullptr)
+		{
+			if (blockSize == requirements.size)
+			{
+				return nullptr;
+			}
+			blockSize = std::max(blockSize / 2, requirements.size);
+		}
+	}
+	if (pTargetBlock->pAllocator->Allocate(requirements.size, requirements.alignment, offset, handle) == false)
+	{
+		return nullptr;
+	}
+	return pTargetBlock;
+}
+
+MemoryBlock* MemoryPool::CreateBlock(MemoryBackend& backend, VkDeviceSize size, uint64 frameIndex)
+{
+	std::unique_ptr<MemoryBlock> pBlock = std::make_unique<MemoryBlock>();
+	if (backend.AllocateMemory(MemoryTypeIndex, size, CpuVisible, nullptr, pBlock->Memory, pBlock->pCpuPointer) == false)
+	{
+		return nullptr;
+	}
+	pBlock->MemoryTypeIndex = MemoryTypeIndex;
+	pBlock->pAllocator = std::make_unique<TLSFAllocator>(size);
+	pBlock->EmptySinceFrame = frameIndex;
+
+	Blocks.push_back(std::move(pBlock));
+	return Blocks.back().get();
+}
+
+void MemoryPool::ReleaseEmptyBlocks(MemoryBackend& backend, uint64 frameIndex, uint64 graceFrames)
+{
+	for (size_t i = 0; i < Blocks.size();)
+	{
+		if (Blocks[i]->pAllocator->IsEmpty() && frameIndex - Blocks[i]->EmptySinceFrame > graceFrames)
+		{
+			backend.FreeMemory(Blocks[i]->Memory, Blocks[i]->pCpuPointer);
+			Blocks.erase(Blocks.begin() + i);
+		}
+		else
+		{
+			++i;
+		}
+	}
+}
+
+void MemoryPool::DestroyBlocks(MemoryBackend& backend)
+{
+	for (auto& pBlock : Blocks)
+	{
+		backend.FreeMemory(pBlock->Memory, pBlock->pCpuPointer);
+	}
+	Blocks.clear();
+}
+
+void MemoryPool::AlignToGranularity(VkMemoryRequirements& requirements, VkDeviceSize bufferImageGranularity)
+{
+	requirements.alignment = std::max(requirements.alignment, bufferImageGranularity);
+	requirements.size = (requirements.size + bufferImageGranularity - 1) & ~(bufferImageGranularity - 1);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "TLSFAllocator.h"
+
+//Creates and destroys the VkDeviceMemory objects that pools sub-allocate.
+//VulkanAllocator allocates from the device, the AllocatorBenchmark hands out memory that doesn't exist
+class MemoryBackend
+{
+public:
+	virtual ~MemoryBackend() {}
+	//'pNext' is chained into the VkMemoryAllocateInfo, 'map' persistently maps the memory to 'pCpuPointer'
+	virtual bool AllocateMemory(uint32 memoryTypeIndex, VkDeviceSize size, bool map, const void* pNext, VkDeviceMemory& memory, void*& pCpuPointer) = 0;
+	virtual void FreeMemory(VkDeviceMemory memory, void* pCpuPointer) = 0;
+};
+
+struct MemoryBlock
+{
+	uint32 MemoryTypeIndex = 0;
+	VkDeviceMemory Memory = VK_NULL_HANDLE;
+	void* pCpuPointer = nullptr;
+	std::unique_ptr<TLSFAllocator> pAllocator;
+	uint64 EmptySinceFrame = 0;
+};
+
+//The blocks of one memory type and the policy that picks a block for a request
+struct MemoryPool
+{
+	uint32 MemoryTypeIndex = 0;
+	bool CpuVisible = false;
+	VkDeviceSize BlockSize = 0;
+	std::vector<std::unique_ptr<MemoryBlock>> Blocks;
+
+	//Anything taking up more than half a block would mostly waste the rest of it
+	bool NeedsDedicatedMemory(VkDeviceSize size) const { return size > BlockSize / 2; }
+	//Takes the first block with room, otherwise grows the pool. Retries with smaller blocks if the backend runs out of memory
+	MemoryBlock* Allocate(MemoryBackend& backend, const VkMemoryRequirements& requirements, uint64 frameIndex, VkDeviceSize& offset, uint32& handle);
+	MemoryBlock* CreateBlock(MemoryBackend& backend, VkDeviceSize size, uint64 frameIndex);
+	//Frees blocks that have been empty for more than 'graceFrames'
+	void ReleaseEmptyBlocks(MemoryBackend& backend, uint64 frameIndex, uint64 graceFrames);
+	void DestroyBlocks(MemoryBackend& backend);
+
+	//Keeps optimal images on their own granularity pages so they never share one with a linear resource
+	static void AlignToGranularity(VkMemoryRequirements& requirements, VkDeviceSize bufferImageGranularity);
+};
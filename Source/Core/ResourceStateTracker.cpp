@@ -0,0 +1,282 @@
+#include "stdafx.h"
+#include "ResourceStateTracker.h"
+#include "Graphics.h"
+#include "CommandBuffer.h"
+
+namespace
+{
+	const VkAccessFlags WRITE_ACCESS =
+		VK_ACCESS_SHADER_WRITE_BIT |
+		VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_TRANSFER_WRITE_BIT |
+		VK_ACCESS_HOST_WRITE_BIT |
+		VK_ACCESS_MEMORY_WRITE_BIT;
+
+	const VkPipelineStageFlags SHADER_STAGES = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+	ResourceState MakeState(VkImageLayout layout, VkAccessFlags access, VkPipelineStageFlags stages)
+	{
+		ResourceState state;
+		state.Layout = layout;
+		state.Access = access;
+		state.Stages = stages;
+		return state;
+	}
+}
+
+ResourceStateTracker::ResourceStateTracker(Graphics* pGraphics) :
+	m_pGraphics(pGraphics)
+{
+}
+
+ResourceStateTracker::~ResourceStateTracker()
+{
+}
+
+void ResourceStateTracker::RegisterImage(VkImage image, VkImageAspectFlags aspectMask, uint32 mipLevels, uint32 arrayLayers, ResourceUsage usage)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	ImageState& imageState = m_Images[image];
+	imageState.AspectMask = aspectMask;
+	imageState.MipLevels = mipLevels;
+	imageState.ArrayLayers = arrayLayers;
+	imageState.Subresources.assign(mipLevels * arrayLayers, GetUsageState(usage));
+}
+
+void ResourceStateTracker::UnregisterImage(VkImage image)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Images.erase(image);
+}
+
+void ResourceStateTracker::UnregisterBuffer(VkBuffer buffer)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Buffers.erase(buffer);
+}
+
+void ResourceStateTracker::UseImage(CommandBuffer* pCommandBuffer, VkImage image, ResourceUsage usage, uint32 mipLevel, uint32 arrayLayer)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto it = m_Images.find(image);
+	assert(it != m_Images.end());
+	ImageState& imageState = it->second;
+	PendingBarriers& pending = m_PendingBarriers[pCommandBuffer];
+	const ResourceState& target = GetUsageState(usage);
+
+	uint32 firstMip = mipLevel == ALL_SUBRESOURCES ? 0 : mipLevel;
+	uint32 lastMip = mipLevel == ALL_SUBRESOURCES ? imageState.MipLevels : mipLevel + 1;
+	uint32 firstLayer = arrayLayer == ALL_SUBRESOURCES ? 0 : arrayLayer;
+	uint32 lastLayer = arrayLayer == ALL_SUBRESOURCES ? imageState.ArrayLayers : arrayLayer + 1;
+
+	//Subresources that are in the same state share one barrier
+	bool uniform = true;
+	const ResourceState& first = imageState.Subresources[firstLayer * imageState.MipLevels + firstMip];
+	for (uint32 layer = firstLayer; layer < lastLayer && uniform; ++layer)
+	{
+		for (uint32 mip = firstMip; mip < lastMip; ++mip)
+		{
+			const ResourceState& state = imageState.Subresources[layer * imageState.MipLevels + mip];
+			if (state.Layout != first.Layout || state.Access != first.Access || state.Stages != first.Stages)
+			{
+				uniform = false;
+				break;
+			}
+		}
+	}
+
+	for (uint32 layer = firstLayer; layer < lastLayer; ++layer)
+	{
+		for (uint32 mip = firstMip; mip < lastMip; ++mip)
+		{
+			ResourceState& state = imageState.Subresources[layer * imageState.MipLevels + mip];
+			VkImageLayout oldLayout = state.Layout;
+			VkAccessFlags srcAccess;
+			VkPipelineStageFlags srcStages;
+			bool needsBarrier = Transition(state, target, srcAccess, srcStages);
+			bool firstSubresource = layer == firstLayer && mip == firstMip;
+			if (needsBarrier && (uniform == false || firstSubresource))
+			{
+				if (uniform)
+				{
+					AddImageBarrier(pending, image, imageState.AspectMask, firstMip, lastMip - firstMip, firstLayer, lastLayer - firstLayer, oldLayout, target, srcAccess, srcStages);
+				}
+				else
+				{
+					AddImageBarrier(pending, image, imageState.AspectMask, mip, 1, layer, 1, oldLayout, target, srcAccess, srcStages);
+				}
+			}
+		}
+	}
+}
+
+void ResourceStateTracker::UseBuffer(CommandBuffer* pCommandBuffer, VkBuffer buffer, ResourceUsage usage)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	//Buffers have no layout, only writes need a barrier
+	ResourceState target = GetUsageState(usage);
+	target.Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	ResourceState& state = m_Buffers[buffer];
+
+	VkAccessFlags srcAccess;
+	VkPipelineStageFlags srcStages;
+	if (Transition(state, target, srcAccess, srcStages) == false || srcStages == 0)
+	{
+		return;
+	}
+
+	//A buffer that is already waiting for a barrier only needs its destination widened
+	PendingBarriers& pending = m_PendingBarriers[pCommandBuffer];
+	auto it = std::find_if(pending.BufferBarriers.begin(), pending.BufferBarriers.end(), [buffer](const VkBufferMemoryBarrier& barrier) { return barrier.buffer == buffer; });
+	if (it != pending.BufferBarriers.end())
+	{
+		it->dstAccessMask |= target.Access;
+	}
+	else
+	{
+		VkBufferMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.pNext = nullptr;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = target.Access;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = buffer;
+		barrier.offset = 0;
+		barrier.size = VK_WHOLE_SIZE;
+		pending.BufferBarriers.push_back(barrier);
+	}
+	pending.SrcStages |= srcStages;
+	pending.DstStages |= target.Stages;
+}
+
+void ResourceStateTracker::SetImageState(VkImage image, ResourceUsage usage)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto it = m_Images.find(image);
+	if (it != m_Images.end())
+	{
+		//Whoever did the transition also made the writes visible
+		ResourceState state = GetUsageState(usage);
+		state.Access &= ~WRITE_ACCESS;
+		it->second.Subresources.assign(it->second.Subresources.size(), state);
+	}
+}
+
+void ResourceStateTracker::SetBufferState(VkBuffer buffer, ResourceUsage usage)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	ResourceState state = GetUsageState(usage);
+	state.Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	state.Access &= ~WRITE_ACCESS;
+	m_Buffers[buffer] = state;
+}
+
+void ResourceStateTracker::FlushBarriers(CommandBuffer* pCommandBuffer)
+{
+	PendingBarriers pending;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto it = m_PendingBarriers.find(pCommandBuffer);
+		if (it == m_PendingBarriers.end())
+		{
+			return;
+		}
+		pending = std::move(it->second);
+		m_PendingBarriers.erase(it);
+	}
+	if (pending.ImageBarriers.empty() && pending.BufferBarriers.empty())
+	{
+		return;
+	}
+
+	VkPipelineStageFlags srcStages = pending.SrcStages != 0 ? pending.SrcStages : (VkPipelineStageFlags)VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	VkPipelineStageFlags dstStages = pending.DstStages != 0 ? pending.DstStages : (VkPipelineStageFlags)VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+	vkCmdPipelineBarrier(pCommandBuffer->GetBuffer(), srcStages, dstStages, 0, 0, nullptr, (uint32)pending.BufferBarriers.size(), pending.BufferBarriers.data(), (uint32)pending.ImageBarriers.size(), pending.ImageBarriers.data());
+}
+
+VkImageLayout ResourceStateTracker::GetImageLayout(VkImage image, uint32 mipLevel, uint32 arrayLayer)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto it = m_Images.find(image);
+	if (it == m_Images.end())
+	{
+		return VK_IMAGE_LAYOUT_UNDEFINED;
+	}
+	return it->second.Subresources[arrayLayer * it->second.MipLevels + mipLevel].Layout;
+}
+
+const ResourceState& ResourceStateTracker::GetUsageState(ResourceUsage usage)
+{
+	static const ResourceState states[] =
+	{
+		MakeState(VK_IMAGE_LAYOUT_UNDEFINED, 0, 0),
+		MakeState(VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT),
+		MakeState(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT),
+		MakeState(VK_IMAGE_LAYOUT_UNDEFINED, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT),
+		MakeState(VK_IMAGE_LAYOUT_UNDEFINED, VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT),
+		MakeState(VK_IMAGE_LAYOUT_UNDEFINED, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT),
+		MakeState(VK_IMAGE_LAYOUT_UNDEFINED, VK_ACCESS_UNIFORM_READ_BIT, SHADER_STAGES),
+		MakeState(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, SHADER_STAGES),
+		MakeState(VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT),
+		MakeState(VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT),
+		MakeState(VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, 0, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT),
+	};
+	static_assert(sizeof(states) / sizeof(states[0]) == (size_t)ResourceUsage::MAX, "Every usage needs a state");
+	return states[(size_t)usage];
+}
+
+bool ResourceStateTracker::Transition(ResourceState& state, const ResourceState& target, VkAccessFlags& srcAccess, VkPipelineStageFlags& srcStages)
+{
+	bool layoutChange = state.Layout != target.Layout;
+	bool hasWrite = ((state.Access | target.Access) & WRITE_ACCESS) != 0;
+	if (layoutChange == false && hasWrite == false)
+	{
+		//Later writes have to wait for every reader
+		state.Access |= target.Access;
+		state.Stages |= target.Stages;
+		return false;
+	}
+
+	//Reads only need an execution dependency, writes have to be made available
+	srcAccess = state.Access & WRITE_ACCESS;
+	srcStages = state.Stages;
+	state = target;
+	return true;
+}
+
+void ResourceStateTracker::AddImageBarrier(PendingBarriers& pending, VkImage image, VkImageAspectFlags aspectMask, uint32 mipLevel, uint32 levelCount, uint32 arrayLayer, uint32 layerCount, VkImageLayout oldLayout, const ResourceState& target, VkAccessFlags srcAccess, VkPipelineStageFlags srcStages)
+{
+	//A subresource that is already waiting for a barrier continues to the new layout in the same barrier
+	for (VkImageMemoryBarrier& barrier : pending.ImageBarriers)
+	{
+		if (barrier.image == image && barrier.subresourceRange.baseMipLevel == mipLevel && barrier.subresourceRange.baseArrayLayer == arrayLayer
+			&& barrier.subresourceRange.levelCount == levelCount && barrier.subresourceRange.layerCount == layerCount)
+		{
+			barrier.newLayout = target.Layout;
+			barrier.dstAccessMask = target.Access;
+			pending.DstStages |= target.Stages;
+			return;
+		}
+	}
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstAccessMask = target.Access;
+	barrier.oldLayout = oldLayout;
+	barrier.newLayout = target.Layout;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = aspectMask;
+	barrier.subresourceRange.baseMipLevel = mipLevel;
+	barrier.subresourceRange.levelCount = levelCount;
+	barrier.subresourceRange.baseArrayLayer = arrayLayer;
+	barrier.subresourceRange.layerCount = layerCount;
+	pending.ImageBarriers.push_back(barrier);
+	pending.SrcStages |= srcStages;
+	pending.DstStages |= target.Stages;
+}
@@ -0,0 +1,89 @@
+#pragma once
+class Graphics;
+class CommandBuffer;
+
+//How a resource is about to be used, this decides the layout, access and stages of its barriers
+enum class ResourceUsage
+{
+	Undefined,
+	TransferSource,
+	TransferDestination,
+	VertexBuffer,
+	IndexBuffer,
+	IndirectArguments,
+	UniformBuffer,
+	ShaderRead,
+	ColorAttachment,
+	DepthAttachment,
+	Present,
+	MAX
+};
+
+struct ResourceState
+{
+	VkImageLayout Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	VkAccessFlags Access = 0;
+	VkPipelineStageFlags Stages = 0;
+};
+
+//Remembers the layout, access and stages of every image subresource and buffer on the graphics queue.
+//Callers declare how they are about to use a resource in a command buffer and the tracker queues the barrier that is needed for it,
+//FlushBarriers records everything queued for the command buffer with one vkCmdPipelineBarrier using only the stages involved.
+//Threads recording different command buffers don't see each other's barriers.
+//Reads after reads in the same layout need no barrier at all.
+//Resources have to be flushed before the commands that use them are recorded, in submission order.
+class ResourceStateTracker
+{
+public:
+	static const uint32 ALL_SUBRESOURCES = ~0u;
+
+	ResourceStateTracker(Graphics* pGraphics);
+	~ResourceStateTracker();
+
+	//Starts tracking an image, replaces the state of a recycled handle
+	void RegisterImage(VkImage image, VkImageAspectFlags aspectMask, uint32 mipLevels, uint32 arrayLayers, ResourceUsage usage = ResourceUsage::Undefined);
+	void UnregisterImage(VkImage image);
+	//Buffers are tracked from their first use, they have to be unregistered when they are released
+	void UnregisterBuffer(VkBuffer buffer);
+
+	void UseImage(CommandBuffer* pCommandBuffer, VkImage image, ResourceUsage usage, uint32 mipLevel = ALL_SUBRESOURCES, uint32 arrayLayer = ALL_SUBRESOURCES);
+	void UseBuffer(CommandBuffer* pCommandBuffer, VkBuffer buffer, ResourceUsage usage);
+	//For transitions done outside of the tracker, eg. by the UploadManager
+	void SetImageState(VkImage image, ResourceUsage usage);
+	void SetBufferState(VkBuffer buffer, ResourceUsage usage);
+
+	void FlushBarriers(CommandBuffer* pCommandBuffer);
+
+	//Undefined for images that aren't tracked
+	VkImageLayout GetImageLayout(VkImage image, uint32 mipLevel = 0, uint32 arrayLayer = 0);
+	static const ResourceState& GetUsageState(ResourceUsage usage);
+
+private:
+	struct ImageState
+	{
+		VkImageAspectFlags AspectMask = 0;
+		uint32 MipLevels = 1;
+		uint32 ArrayLayers = 1;
+		//Indexed by array layer * mip levels + mip level
+		std::vector<ResourceState> Subresources;
+	};
+
+	struct PendingBarriers
+	{
+		std::vector<VkImageMemoryBarrier> ImageBarriers;
+		std::vector<VkBufferMemoryBarrier> BufferBarriers;
+		VkPipelineStageFlags SrcStages = 0;
+		VkPipelineStageFlags DstStages = 0;
+	};
+
+	//Returns false if no barrier is needed, in that case the read is merged into 'state'
+	static bool Transition(ResourceState& state, const ResourceState& target, VkAccessFlags& srcAccess, VkPipelineStageFlags& srcStages);
+	static void AddImageBarrier(PendingBarriers& pending, VkImage image, VkImageAspectFlags aspectMask, uint32 mipLevel, uint32 levelCount, uint32 arrayLayer, uint32 layerCount, VkImageLayout oldLayout, const ResourceState& target, VkAccessFlags srcAccess, VkPipelineStageFlags srcStages);
+
+	Graphics* m_pGraphics;
+	std::mutex m_Mutex;
+	std::map<VkImage, ImageState> m_Images;
+	std::map<VkBuffer, ResourceState> m_Buffers;
+	//Removed when they are flushed
+	std::map<CommandBuffer*, PendingBarriers> m_PendingBarriers;
+};
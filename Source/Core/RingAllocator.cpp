@@ -0,0 +1,98 @@
+#include "stdafx.h"
+#include "RingAllocator.h"
+#include "Graphics.h"
+#include "Helpers/VulkanHelpers.h"
+
+RingAllocator::RingAllocator(Graphics* pGraphics, VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memoryUsage) :
+	m_pGraphics(pGraphics), m_Size(size)
+{
+	VkBufferCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	createInfo.flags = 0;
+	createInfo.pNext = nullptr;
+	createInfo.pQueueFamilyIndices = nullptr;
+	createInfo.queueFamilyIndexCount = 0;
+	createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	createInfo.size = size;
+	createInfo.usage = usage;
+	VK_LOG(vkCreateBuffer(m_pGraphics->GetDevice(), &createInfo, nullptr, &m_Buffer));
+
+	m_Allocation = m_pGraphics->GetAllocator()->Allocate(m_Buffer, memoryUsage);
+	VK_LOG(vkBindBufferMemory(m_pGraphics->GetDevice(), m_Buffer, m_Allocation.Memory, m_Allocation.Offset));
+}
+
+RingAllocator::~RingAllocator()
+{
+	vkDestroyBuffer(m_pGraphics->GetDevice(), m_Buffer, nullptr);
+	m_pGraphics->GetAllocator()->Free(m_Allocation);
+}
+
+RingAllocation RingAllocator::Allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+	RingAllocation allocation;
+	if (TryAllocate(size, alignment, allocation) == false)
+	{
+		std::cout << "RingAllocator is full! Failed to allocate " << size << " bytes" << std::endl;
+	}
+	return allocation;
+}
+
+bool RingAllocator::TryAllocate(VkDeviceSize size, VkDeviceSize alignment, RingAllocation& allocation)
+{
+	if (size > m_Size)
+	{
+		return false;
+	}
+
+	VkDeviceSize offset = (m_Head + alignment - 1) / alignment * alignment;
+	VkDeviceSize consumed = offset + size - m_Head;
+	if (offset + size > m_Size)
+	{
+		//Wrap around, the space left at the end is wasted until the segment retires
+		offset = 0;
+		consumed = m_Size - m_Head + size;
+	}
+	if (m_UsedSize + consumed > m_Size)
+	{
+		return false;
+	}
+
+	m_Head = offset + size;
+	m_UsedSize += consumed;
+	m_CurrentSegmentSize += consumed;
+
+	allocation.Buffer = m_Buffer;
+	allocation.Offset = offset;
+	allocation.Size = size;
+	allocation.pCpuPointer = (char*)m_Allocation.pCpuPointer + offset;
+	return true;
+}
+
+void RingAllocator::Flush(const RingAllocation& allocation)
+{
+	m_pGraphics->GetAllocator()->Flush(m_Allocation, allocation.Offset, allocation.Size);
+}
+
+void RingAllocator::EndSegment(uint64 fenceId)
+{
+	assert(m_Segments.empty() || m_Segments.back().FenceId <= fenceId);
+
+	Segment segment;
+	segment.FenceId = fenceId;
+	segment.Size = m_CurrentSegmentSize;
+	m_Segments.push_back(segment);
+	m_CurrentSegmentSize = 0;
+}
+
+void RingAllocator::Retire(uint64 fenceId)
+{
+	while (m_Segments.empty() == false && m_Segments.front().FenceId <= fenceId)
+	{
+		m_UsedSize -= m_Segments.front().Size;
+		m_Segments.pop_front();
+	}
+	if (m_UsedSize == 0)
+	{
+		m_Head = 0;
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "VulkanAllocator.h"
+class Graphics;
+
+struct RingAllocation
+{
+	VkBuffer Buffer = VK_NULL_HANDLE;
+	VkDeviceSize Offset = 0;
+	VkDeviceSize Size = 0;
+	void* pCpuPointer = nullptr;
+
+	bool IsValid() const { return pCpuPointer != nullptr; }
+};
+
+//Persistently mapped ring buffer for transient data like uniforms, dynamic vertices and staging.
+//Allocations are grouped in segments that are tagged with a fence id,
+//a segment gets reclaimed once its fence id is retired.
+class RingAllocator
+{
+public:
+	RingAllocator(Graphics* pGraphics, VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memoryUsage = MemoryUsage::CpuToGpuDeviceLocal);
+	~RingAllocator();
+
+	RingAllocation Allocate(VkDeviceSize size, VkDeviceSize alignment);
+	//Same as Allocate but running out of space is not an error
+	bool TryAllocate(VkDeviceSize size, VkDeviceSize alignment, RingAllocation& allocation);
+	//Makes CPU writes visible when the memory is not host coherent
+	void Flush(const RingAllocation& allocation);
+
+	//Closes the current segment and tags it with 'fenceId'. Fence ids must be increasing
+	void EndSegment(uint64 fenceId);
+	//Reclaims all segments up to and including 'fenceId'
+	void Retire(uint64 fenceId);
+
+	VkBuffer GetBuffer() const { return m_Buffer; }
+	VkDeviceSize GetSize() const { return m_Size; }
+	VkDeviceSize GetUsedSize() const { return m_UsedSize; }
+
+private:
+	struct Segment
+	{
+		uint64 FenceId;
+		VkDeviceSize Size;
+	};
+
+	Graphics* m_pGraphics;
+	VkBuffer m_Buffer = VK_NULL_HANDLE;
+	VulkanAllocation m_Allocation;
+
+	VkDeviceSize m_Size = 0;
+	VkDeviceSize m_Head = 0;
+	VkDeviceSize m_UsedSize = 0;
+	VkDeviceSize m_CurrentSegmentSize = 0;
+	std::deque<Segment> m_Segments;
+};
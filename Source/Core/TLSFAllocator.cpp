@@ -0,0 +1,331 @@
+#include "stdafx.h"
+#include "TLSFAllocator.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+	uint32 LowestBitIndex(uint64 mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+#ifdef _WIN64
+		_BitScanForward64(&index, mask);
+#else
+		if (_BitScanForward(&index, (unsigned long)mask) == 0)
+		{
+			_BitScanForward(&index, (unsigned long)(mask >> 32));
+			index += 32;
+		}
+#endif
+		return (uint32)index;
+#else
+		return (uint32)__builtin_ctzll(mask);
+#endif
+	}
+
+	uint32 HighestBitIndex(uint64 mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+#ifdef _WIN64
+		_BitScanReverse64(&index, mask);
+#else
+		if (_BitScanReverse(&index, (unsigned long)(mask >> 32)) != 0)
+		{
+			index += 32;
+		}
+		else
+		{
+			_BitScanReverse(&index, (unsigned long)mask);
+		}
+#endif
+		return (uint32)index;
+#else
+		return 63 - (uint32)__builtin_clzll(mask);
+#endif
+	}
+
+	uint64 AlignUp(uint64 value, uint64 alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+TLSFAllocator::TLSFAllocator(uint64 size) :
+	m_Size(size)
+{
+	for (uint32 fl = 0; fl < FL_INDEX_COUNT; ++fl)
+	{
+		for (uint32 sl = 0; sl < SL_INDEX_COUNT; ++sl)
+		{
+			m_FreeLists[fl][sl] = INVALID_HANDLE;
+		}
+	}
+
+	uint32 node = CreateNode();
+	m_Nodes[node].Offset = 0;
+	m_Nodes[node].Size = size;
+	InsertFreeNode(node);
+}
+
+TLSFAllocator::~TLSFAllocator()
+{
+}
+
+bool TLSFAllocator::Allocate(uint64 size, uint64 alignment, uint64& offset, uint32& handle)
+{
+	if (size == 0 || size > m_Size - m_UsedSize)
+	{
+		return false;
+	}
+	if (alignment == 0)
+	{
+		alignment = 1;
+	}
+
+	//First try the list that fits the size, its head is often aligned already.
+	//Otherwise search for a node that is guaranteed to fit after alignment padding.
+	uint32 node = FindFreeNode(size);
+	if (node == INVALID_HANDLE || AlignUp(m_Nodes[node].Offset, alignment) + size > m_Nodes[node].Offset + m_Nodes[node].Size)
+	{
+		node = FindFreeNode(size + alignment - 1);
+		if (node == INVALID_HANDLE)
+		{
+			return false;
+		}
+	}
+	RemoveFreeNode(node);
+
+	uint64 padding = AlignUp(m_Nodes[node].Offset, alignment) - m_Nodes[node].Offset;
+	if (padding > 0)
+	{
+		uint32 front = node;
+		node = SplitNode(front, padding);
+		InsertFreeNode(front);
+	}
+	if (m_Nodes[node].Size > size)
+	{
+		uint32 remainder = SplitNode(node, size);
+		InsertFreeNode(remainder);
+	}
+
+	m_Nodes[node].Free = false;
+	m_Nodes[node].Padding = padding;
+	m_Nodes[node].pUserData = nullptr;
+	m_UsedSize += size;
+	m_PaddingSize += padding;
+	++m_AllocationCount;
+
+	offset = m_Nodes[node].Offset;
+	handle = node;
+	return true;
+}
+
+void TLSFAllocator::Free(uint32 handle)
+{
+	assert(handle < m_Nodes.size() && m_Nodes[handle].Free == false);
+
+	uint32 node = handle;
+	m_Nodes[node].Free = true;
+	m_UsedSize -= m_Nodes[node].Size;
+	m_PaddingSize -= m_Nodes[node].Padding;
+	--m_AllocationCount;
+
+	//Merge with the previous node
+	uint32 prev = m_Nodes[node].PrevPhysical;
+	if (prev != INVALID_HANDLE && m_Nodes[prev].Free)
+	{
+		RemoveFreeNode(prev);
+		m_Nodes[prev].Size += m_Nodes[node].Size;
+		m_Nodes[prev].NextPhysical = m_Nodes[node].NextPhysical;
+		if (m_Nodes[node].NextPhysical != INVALID_HANDLE)
+		{
+			m_Nodes[m_Nodes[node].NextPhysical].PrevPhysical = prev;
+		}
+		ReleaseNode(node);
+		node = prev;
+	}
+
+	//Merge with the next node
+	uint32 next = m_Nodes[node].NextPhysical;
+	if (next != INVALID_HANDLE && m_Nodes[next].Free)
+	{
+		RemoveFreeNode(next);
+		m_Nodes[node].Size += m_Nodes[next].Size;
+		m_Nodes[node].NextPhysical = m_Nodes[next].NextPhysical;
+		if (m_Nodes[next].NextPhysical != INVALID_HANDLE)
+		{
+			m_Nodes[m_Nodes[next].NextPhysical].PrevPhysical = node;
+		}
+		ReleaseNode(next);
+	}
+
+	InsertFreeNode(node);
+}
+
+uint64 TLSFAllocator::GetLargestFreeRange() const
+{
+	if (m_FlBitmap == 0)
+	{
+		return 0;
+	}
+	//The largest range is in the highest non-empty list, the nodes in a list differ in size
+	uint32 fl = HighestBitIndex(m_FlBitmap);
+	uint32 sl = HighestBitIndex(m_SlBitmaps[fl]);
+	uint64 largest = 0;
+	for (uint32 node = m_FreeLists[fl][sl]; node != INVALID_HANDLE; node = m_Nodes[node].NextFree)
+	{
+		largest = std::max(largest, m_Nodes[node].Size);
+	}
+	return largest;
+}
+
+void TLSFAllocator::GetAllocations(std::vector<uint32>& handles) const
+{
+	//The first node always stays at offset 0, merges keep the lower node
+	for (uint32 node = 0; node != INVALID_HANDLE; node = m_Nodes[node].NextPhysical)
+	{
+		if (m_Nodes[node].Free == false)
+		{
+			handles.push_back(node);
+		}
+	}
+}
+
+void TLSFAllocator::MappingInsert(uint64 size, uint32& fl, uint32& sl) const
+{
+	if (size < SL_INDEX_COUNT)
+	{
+		fl = 0;
+		sl = (uint32)size;
+	}
+	else
+	{
+		uint32 msb = HighestBitIndex(size);
+		fl = msb - SL_INDEX_COUNT_LOG2 + 1;
+		sl = (uint32)(size >> (msb - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+	}
+}
+
+void TLSFAllocator::MappingSearch(uint64 size, uint32& fl, uint32& sl) const
+{
+	//Round up to the next list so every node in the found list is large enough
+	if (size >= SL_INDEX_COUNT)
+	{
+		uint64 round = (1ull << (HighestBitIndex(size) - SL_INDEX_COUNT_LOG2)) - 1;
+		if (size + round > size)
+		{
+			size += round;
+		}
+	}
+	MappingInsert(size, fl, sl);
+}
+
+uint32 TLSFAllocator::FindFreeNode(uint64 size) const
+{
+	uint32 fl, sl;
+	MappingSearch(size, fl, sl);
+
+	uint32 slMap = m_SlBitmaps[fl] & (~0u << sl);
+	if (slMap == 0)
+	{
+		uint64 flMap = fl + 1 < 64 ? m_FlBitmap & (~0ull << (fl + 1)) : 0;
+		if (flMap == 0)
+		{
+			return INVALID_HANDLE;
+		}
+		fl = LowestBitIndex(flMap);
+		slMap = m_SlBitmaps[fl];
+	}
+	sl = LowestBitIndex(slMap);
+	return m_FreeLists[fl][sl];
+}
+
+void TLSFAllocator::InsertFreeNode(uint32 node)
+{
+	uint32 fl, sl;
+	MappingInsert(m_Nodes[node].Size, fl, sl);
+
+	uint32 head = m_FreeLists[fl][sl];
+	m_Nodes[node].Free = true;
+	m_Nodes[node].PrevFree = INVALID_HANDLE;
+	m_Nodes[node].NextFree = head;
+	if (head != INVALID_HANDLE)
+	{
+		m_Nodes[head].PrevFree = node;
+	}
+	m_FreeLists[fl][sl] = node;
+	m_FlBitmap |= 1ull << fl;
+	m_SlBitmaps[fl] |= 1u << sl;
+}
+
+void TLSFAllocator::RemoveFreeNode(uint32 node)
+{
+	uint32 fl, sl;
+	MappingInsert(m_Nodes[node].Size, fl, sl);
+
+	uint32 prev = m_Nodes[node].PrevFree;
+	uint32 next = m_Nodes[node].NextFree;
+	if (prev != INVALID_HANDLE)
+	{
+		m_Nodes[prev].NextFree = next;
+	}
+	if (next != INVALID_HANDLE)
+	{
+		m_Nodes[next].PrevFree = prev;
+	}
+	if (m_FreeLists[fl][sl] == node)
+	{
+		m_FreeLists[fl][sl] = next;
+		if (next == INVALID_HANDLE)
+		{
+			m_SlBitmaps[fl] &= ~(1u << sl);
+			if (m_SlBitmaps[fl] == 0)
+			{
+				m_FlBitmap &= ~(1ull << fl);
+			}
+		}
+	}
+	m_Nodes[node].PrevFree = INVALID_HANDLE;
+	m_Nodes[node].NextFree = INVALID_HANDLE;
+	m_Nodes[node].Free = false;
+}
+
+uint32 TLSFAllocator::SplitNode(uint32 node, uint64 size)
+{
+	//Keeps the first 'size' bytes in 'node' and returns a node for the remainder
+	uint32 remainder = CreateNode();
+	m_Nodes[remainder].Offset = m_Nodes[node].Offset + size;
+	m_Nodes[remainder].Size = m_Nodes[node].Size - size;
+	m_Nodes[remainder].PrevPhysical = node;
+	m_Nodes[remainder].NextPhysical = m_Nodes[node].NextPhysical;
+	if (m_Nodes[node].NextPhysical != INVALID_HANDLE)
+	{
+		m_Nodes[m_Nodes[node].NextPhysical].PrevPhysical = remainder;
+	}
+	m_Nodes[node].NextPhysical = remainder;
+	m_Nodes[node].Size = size;
+	return remainder;
+}
+
+uint32 TLSFAllocator::CreateNode()
+{
+	if (m_UnusedNodes.size() > 0)
+	{
+		uint32 node = m_UnusedNodes.back();
+		m_UnusedNodes.pop_back();
+		m_Nodes[node] = Node();
+		return node;
+	}
+	m_Nodes.push_back(Node());
+	return (uint32)m_Nodes.size() - 1;
+}
+
+void TLSFAllocator::ReleaseNode(uint32 node)
+{
+	m_Nodes[node] = Node();
+	m_UnusedNodes.push_back(node);
+}
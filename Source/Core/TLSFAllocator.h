@@ -0,0 +1,71 @@
+#pragma once
+
+//Two-Level Segregated Fit allocator
+//Only manages offsets within a range, it never touches the memory itself.
+//Allocate and Free are O(1) and adjacent free ranges are coalesced on Free.
+class TLSFAllocator
+{
+public:
+	static const uint32 INVALID_HANDLE = 0xFFFFFFFF;
+
+	TLSFAllocator(uint64 size);
+	~TLSFAllocator();
+
+	bool Allocate(uint64 size, uint64 alignment, uint64& offset, uint32& handle);
+	void Free(uint32 handle);
+
+	uint64 GetSize() const { return m_Size; }
+	uint64 GetUsedSize() const { return m_UsedSize; }
+	//Bytes skipped in front of live allocations to align them
+	uint64 GetPaddingSize() const { return m_PaddingSize; }
+	int GetAllocationCount() const { return m_AllocationCount; }
+	bool IsEmpty() const { return m_AllocationCount == 0; }
+	uint64 GetLargestFreeRange() const;
+
+	void SetUserData(uint32 handle, void* pUserData) { m_Nodes[handle].pUserData = pUserData; }
+	void* GetUserData(uint32 handle) const { return m_Nodes[handle].pUserData; }
+	uint64 GetAllocationSize(uint32 handle) const { return m_Nodes[handle].Size; }
+	uint64 GetAllocationOffset(uint32 handle) const { return m_Nodes[handle].Offset; }
+	//Appends the handles of all live allocations in address order
+	void GetAllocations(std::vector<uint32>& handles) const;
+
+private:
+	static const uint32 SL_INDEX_COUNT_LOG2 = 4;
+	static const uint32 SL_INDEX_COUNT = 1 << SL_INDEX_COUNT_LOG2;
+	static const uint32 FL_INDEX_COUNT = 64 - SL_INDEX_COUNT_LOG2 + 1;
+
+	struct Node
+	{
+		uint64 Offset = 0;
+		uint64 Size = 0;
+		uint32 PrevPhysical = INVALID_HANDLE;
+		uint32 NextPhysical = INVALID_HANDLE;
+		uint32 PrevFree = INVALID_HANDLE;
+		uint32 NextFree = INVALID_HANDLE;
+		bool Free = false;
+		uint64 Padding = 0;
+		void* pUserData = nullptr;
+	};
+
+	void MappingInsert(uint64 size, uint32& fl, uint32& sl) const;
+	void MappingSearch(uint64 size, uint32& fl, uint32& sl) const;
+	uint32 FindFreeNode(uint64 size) const;
+	void InsertFreeNode(uint32 node);
+	void RemoveFreeNode(uint32 node);
+	uint32 SplitNode(uint32 node, uint64 size);
+
+	uint32 CreateNode();
+	void ReleaseNode(uint32 node);
+
+	uint64 m_Size;
+	uint64 m_UsedSize = 0;
+	uint64 m_PaddingSize = 0;
+	int m_AllocationCount = 0;
+
+	uint64 m_FlBitmap = 0;
+	uint32 m_SlBitmaps[FL_INDEX_COUNT] = {};
+	uint32 m_FreeLists[FL_INDEX_COUNT][SL_INDEX_COUNT];
+
+	std::vector<Node> m_Nodes;
+	std::vector<uint32> m_UnusedNodes;
+};
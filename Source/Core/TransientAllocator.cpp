@@ -0,0 +1,146 @@
+#include "stdafx.h"
+#include "TransientAllocator.h"
+#include "Graphics.h"
+#include "Helpers/VulkanHelpers.h"
+
+TransientAllocator::TransientAllocator(Graphics* pGraphics) :
+	m_pGraphics(pGraphics)
+{
+}
+
+TransientAllocator::~TransientAllocator()
+{
+	Reset();
+}
+
+void TransientAllocator::DeclareImage(VkImage image, uint32 firstPass, uint32 lastPass, const std::function<void()>& onBound)
+{
+	std::unique_ptr<TransientResource> pResource = std::make_unique<TransientResource>();
+	pResource->Image = image;
+	pResource->FirstPass = firstPass;
+	pResource->LastPass = lastPass;
+	pResource->OnBound = onBound;
+	vkGetImageMemoryRequirements(m_pGraphics->GetDevice(), image, &pResource->Requirements);
+	m_Resources.push_back(std::move(pResource));
+}
+
+void TransientAllocator::DeclareBuffer(VkBuffer buffer, uint32 firstPass, uint32 lastPass, const std::function<void()>& onBound)
+{
+	std::unique_ptr<TransientResource> pResource = std::make_unique<TransientResource>();
+	pResource->Buffer = buffer;
+	pResource->FirstPass = firstPass;
+	pResource->LastPass = lastPass;
+	pResource->OnBound = onBound;
+	vkGetBufferMemoryRequirements(m_pGraphics->GetDevice(), buffer, &pResource->Requirements);
+	m_Resources.push_back(std::move(pResource));
+}
+
+void TransientAllocator::Build()
+{
+	ReleaseHeaps();
+
+	//Buffers and images can share a heap, keep them on separate granularity pages
+	VkDeviceSize granularity = m_pGraphics->GetDeviceProperties().limits.bufferImageGranularity;
+
+	//Resources can only share memory if they accept the same memory types
+	for (auto& pResource : m_Resources)
+	{
+		pResource->Requirements.alignment = std::max(pResource->Requirements.alignment, granularity);
+		pResource->Requirements.size = (pResource->Requirements.size + granularity - 1) / granularity * granularity;
+		m_UnaliasedSize += pResource->Requirements.size;
+
+		auto heap = std::find_if(m_Heaps.begin(), m_Heaps.end(), [&pResource](const TransientHeap& heap) { return heap.MemoryTypeBits == pResource->Requirements.memoryTypeBits; });
+		if (heap == m_Heaps.end())
+		{
+			m_Heaps.push_back(TransientHeap());
+			heap = m_Heaps.end() - 1;
+			heap->MemoryTypeBits = pResource->Requirements.memoryTypeBits;
+		}
+		heap->Resources.push_back(pResource.get());
+	}
+
+	for (TransientHeap& heap : m_Heaps)
+	{
+		PackHeap(heap);
+		m_AliasedSize += heap.Size;
+
+		VkMemoryRequirements requirements;
+		requirements.size = heap.Size;
+		requirements.alignment = heap.Alignment;
+		requirements.memoryTypeBits = heap.MemoryTypeBits;
+		heap.Allocation = m_pGraphics->GetAllocator()->AllocateMemory(requirements, MemoryUsage::GpuOnly, true);
+
+		for (TransientResource* pResource : heap.Resources)
+		{
+			if (pResource->Image != VK_NULL_HANDLE)
+			{
+				VK_LOG(vkBindImageMemory(m_pGraphics->GetDevice(), pResource->Image, heap.Allocation.Memory, heap.Allocation.Offset + pResource->Offset));
+			}
+			else
+			{
+				VK_LOG(vkBindBufferMemory(m_pGraphics->GetDevice(), pResource->Buffer, heap.Allocation.Memory, heap.Allocation.Offset + pResource->Offset));
+			}
+			if (pResource->OnBound)
+			{
+				pResource->OnBound();
+			}
+		}
+	}
+}
+
+void TransientAllocator::Reset()
+{
+	ReleaseHeaps();
+	m_Resources.clear();
+}
+
+void TransientAllocator::ReleaseHeaps()
+{
+	for (TransientHeap& heap : m_Heaps)
+	{
+		m_pGraphics->GetAllocator()->Free(heap.Allocation);
+	}
+	m_Heaps.clear();
+	m_UnaliasedSize = 0;
+	m_AliasedSize = 0;
+}
+
+void TransientAllocator::PackHeap(TransientHeap& heap)
+{
+	//Place the largest resources first, each at the lowest offset
+	//that doesn't collide with a placed resource that is alive at the same time
+	std::vector<TransientResource*> resources = heap.Resources;
+	std::sort(resources.begin(), resources.end(), [](const TransientResource* a, const TransientResource* b) { return a->Requirements.size > b->Requirements.size; });
+
+	std::vector<TransientResource*> placed;
+	std::vector<TransientResource*> overlapping;
+	for (TransientResource* pResource : resources)
+	{
+		overlapping.clear();
+		for (TransientResource* pOther : placed)
+		{
+			if (pOther->FirstPass <= pResource->LastPass && pResource->FirstPass <= pOther->LastPass)
+			{
+				overlapping.push_back(pOther);
+			}
+		}
+		std::sort(overlapping.begin(), overlapping.end(), [](const TransientResource* a, const TransientResource* b) { return a->Offset < b->Offset; });
+
+		const VkDeviceSize alignment = pResource->Requirements.alignment;
+		VkDeviceSize offset = 0;
+		for (TransientResource* pOther : overlapping)
+		{
+			VkDeviceSize alignedOffset = (offset + alignment - 1) / alignment * alignment;
+			if (alignedOffset + pResource->Requirements.size <= pOther->Offset)
+			{
+				break;
+			}
+			offset = std::max(offset, pOther->Offset + pOther->Requirements.size);
+		}
+		pResource->Offset = (offset + alignment - 1) / alignment * alignment;
+		placed.push_back(pResource);
+
+		heap.Size = std::max(heap.Size, pResource->Offset + pResource->Requirements.size);
+		heap.Alignment = std::max(heap.Alignment, alignment);
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "VulkanAllocator.h"
+class Graphics;
+
+//Places resources that are only used by a range of passes within a frame in shared memory.
+//Resources get declared with the first and last pass they are used in,
+//resources whose pass ranges don't overlap are placed at the same offset.
+//Aliased memory is undefined on first use in a frame, images have to be transitioned from VK_IMAGE_LAYOUT_UNDEFINED.
+class TransientAllocator
+{
+public:
+	TransientAllocator(Graphics* pGraphics);
+	~TransientAllocator();
+
+	//'onBound' is called once the resource has memory bound, eg. to create views
+	void DeclareImage(VkImage image, uint32 firstPass, uint32 lastPass, const std::function<void()>& onBound);
+	void DeclareBuffer(VkBuffer buffer, uint32 firstPass, uint32 lastPass, const std::function<void()>& onBound);
+
+	//Packs all declared resources, allocates the memory and binds the resources
+	void Build();
+	//Releases the memory and forgets the declared resources. The resources have to be destroyed by their owners first
+	void Reset();
+
+	//Memory the resources would take without aliasing and what they take now
+	VkDeviceSize GetUnaliasedSize() const { return m_UnaliasedSize; }
+	VkDeviceSize GetAliasedSize() const { return m_AliasedSize; }
+
+private:
+	struct TransientResource
+	{
+		VkImage Image = VK_NULL_HANDLE;
+		VkBuffer Buffer = VK_NULL_HANDLE;
+		VkMemoryRequirements Requirements;
+		uint32 FirstPass = 0;
+		uint32 LastPass = 0;
+		VkDeviceSize Offset = 0;
+		std::function<void()> OnBound;
+	};
+
+	struct TransientHeap
+	{
+		uint32 MemoryTypeBits = 0;
+		VkDeviceSize Size = 0;
+		VkDeviceSize Alignment = 1;
+		std::vector<TransientResource*> Resources;
+		VulkanAllocation Allocation;
+	};
+
+	void PackHeap(TransientHeap& heap);
+	void ReleaseHeaps();
+
+	Graphics* m_pGraphics;
+	std::vector<std::unique_ptr<TransientResource>> m_Resources;
+	std::vector<TransientHeap> m_Heaps;
+
+	VkDeviceSize m_UnaliasedSize = 0;
+	VkDeviceSize m_AliasedSize = 0;
+};
@@ -0,0 +1,534 @@
+#include "stdafx.h"
+#include "UploadManager.h"
+#include "Graphics.h"
+#include "CommandBuffer.h"
+#include "CommandBufferPool.h"
+#include "FencePool.h"
+#include "Helpers/VulkanHelpers.h"
+
+UploadManager::UploadManager(Graphics* pGraphics, VkDeviceSize stagingSize) :
+	m_pGraphics(pGraphics), m_SubmitThread(std::this_thread::get_id())
+{
+	m_pStagingRing = std::make_unique<RingAllocator>(pGraphics, stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryUsage::CpuToGpu);
+	m_MaxChunkSize = stagingSize / MAX_CHUNKS_PER_RING;
+	//Image copies need at least texel alignment, only 4 byte formats are uploaded for now
+	m_CopyAlignment = std::max<VkDeviceSize>(m_pGraphics->GetDeviceProperties().limits.optimalBufferCopyOffsetAlignment, 4);
+	m_pFencePool = std::make_unique<FencePool>(pGraphics);
+
+	m_CurrentBatch.Token = 1;
+}
+
+UploadManager::~UploadManager()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	Submit();
+	RetireBatches(true);
+	m_pStagingRing.reset();
+	m_TransferCommandPools.clear();
+	m_GraphicsCommandPools.clear();
+	m_pFencePool.reset();
+	for (VkSemaphore semaphore : m_Semaphores)
+	{
+		vkDestroySemaphore(m_pGraphics->GetDevice(), semaphore, nullptr);
+	}
+}
+
+uint64 UploadManager::UploadBuffer(VkBuffer target, ResourceUsage usage, const void* pData, VkDeviceSize size, VkDeviceSize offset, bool preserveContents)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	//Like images, the graphics queue sees the buffer only after this batch
+	m_pGraphics->GetResourceStateTracker()->SetBufferState(target, usage);
+
+	bool graphicsQueue = preserveContents && HasTransferQueue();
+	for (VkDeviceSize chunkOffset = 0; chunkOffset < size; chunkOffset += m_MaxChunkSize)
+	{
+		VkDeviceSize chunkSize = std::min(m_MaxChunkSize, size - chunkOffset);
+		RingAllocation staging = AllocateStaging(lock, (const char*)pData + chunkOffset, chunkSize);
+
+		VkBufferCopy region = {};
+		region.srcOffset = staging.Offset;
+		region.dstOffset = offset + chunkOffset;
+		region.size = chunkSize;
+		AddBufferCopy(graphicsQueue ? m_CurrentBatch.GraphicsCopies : m_CurrentBatch.TransferCopies, target, region);
+	}
+
+	CopyList& list = graphicsQueue ? m_CurrentBatch.GraphicsCopies : m_CurrentBatch.TransferCopies;
+	VkAccessFlags dstAccess;
+	AddUsage(list, usage, dstAccess);
+	auto it = std::find_if(list.BufferBarriers.begin(), list.BufferBarriers.end(), [target](const VkBufferMemoryBarrier& barrier) { return barrier.buffer == target; });
+	if (it != list.BufferBarriers.end())
+	{
+		it->dstAccessMask |= dstAccess;
+	}
+	else
+	{
+		bool release = graphicsQueue == false && HasTransferQueue();
+		VkBufferMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.pNext = nullptr;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = dstAccess;
+		barrier.srcQueueFamilyIndex = release ? m_pGraphics->GetTransferQueueFamilyIndex() : VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = release ? m_pGraphics->GetQueueFamilyIndex() : VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = target;
+		barrier.offset = 0;
+		barrier.size = VK_WHOLE_SIZE;
+		list.BufferBarriers.push_back(barrier);
+	}
+	return m_CurrentBatch.Token;
+}
+
+uint64 UploadManager::UploadImage(VkImage target, ResourceUsage usage, VkImageAspectFlags aspectMask, uint32 mipLevel, int x, int y, uint32 width, uint32 height, const void* pData, VkDeviceSize size)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	//The tracker already expects the new layout, the graphics queue sees the image only after this batch
+	ResourceStateTracker* pTracker = m_pGraphics->GetResourceStateTracker();
+	VkImageLayout oldLayout = pTracker->GetImageLayout(target, mipLevel);
+	VkImageLayout newLayout = ResourceStateTracker::GetUsageState(usage).Layout;
+	assert(newLayout != VK_IMAGE_LAYOUT_UNDEFINED);
+	pTracker->SetImageState(target, usage);
+
+	//Large images are split into bands of rows
+	VkDeviceSize rowPitch = size / height;
+	uint32 rowsPerChunk = (uint32)std::max<VkDeviceSize>(m_MaxChunkSize / rowPitch, 1);
+
+	bool graphicsQueue = oldLayout != VK_IMAGE_LAYOUT_UNDEFINED && HasTransferQueue();
+	for (uint32 row = 0; row < height; row += rowsPerChunk)
+	{
+		uint32 rowCount = std::min(rowsPerChunk, height - row);
+		RingAllocation staging = AllocateStaging(lock, (const char*)pData + row * rowPitch, rowCount * rowPitch);
+
+		VkBufferImageCopy region = {};
+		region.imageSubresource.aspectMask = aspectMask;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageSubresource.mipLevel = mipLevel;
+		region.bufferOffset = staging.Offset;
+		region.imageOffset.x = x;
+		region.imageOffset.y = y + (int)row;
+		region.imageExtent.width = width;
+		region.imageExtent.height = rowCount;
+		region.imageExtent.depth = 1;
+		AddImageCopy(graphicsQueue ? m_CurrentBatch.GraphicsCopies : m_CurrentBatch.TransferCopies, target, aspectMask, oldLayout, row == 0, region);
+	}
+
+	CopyList& list = graphicsQueue ? m_CurrentBatch.GraphicsCopies : m_CurrentBatch.TransferCopies;
+	VkAccessFlags dstAccess;
+	AddUsage(list, usage, dstAccess);
+	auto it = std::find_if(list.ImageBarriers.begin(), list.ImageBarriers.end(), [target](const VkImageMemoryBarrier& barrier) { return barrier.image == target; });
+	if (it == list.ImageBarriers.end())
+	{
+		//The layout transition is part of the ownership transfer, the release and acquire barrier have to match
+		bool release = graphicsQueue == false && HasTransferQueue();
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.pNext = nullptr;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = dstAccess;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = newLayout;
+		barrier.srcQueueFamilyIndex = release ? m_pGraphics->GetTransferQueueFamilyIndex() : VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = release ? m_pGraphics->GetQueueFamilyIndex() : VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = target;
+		barrier.subresourceRange.aspectMask = aspectMask;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+		list.ImageBarriers.push_back(barrier);
+	}
+	return m_CurrentBatch.Token;
+}
+
+void UploadManager::BeginBatch()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	++m_BatchDepths[std::this_thread::get_id()];
+}
+
+uint64 UploadManager::EndBatch()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto it = m_BatchDepths.find(std::this_thread::get_id());
+	assert(it != m_BatchDepths.end());
+	if (--it->second == 0)
+	{
+		m_BatchDepths.erase(it);
+	}
+	return m_CurrentBatch.Token;
+}
+
+void UploadManager::Flush()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (m_BatchDepths.find(m_SubmitThread) == m_BatchDepths.end())
+	{
+		Submit();
+	}
+	RetireBatches(false);
+}
+
+void UploadManager::Wait(uint64 token)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (token == m_CurrentBatch.Token)
+	{
+		Submit();
+	}
+	for (Batch& batch : m_SubmittedBatches)
+	{
+		if (batch.Token == token)
+		{
+			vkWaitForFences(m_pGraphics->GetDevice(), 1, &batch.Fence, VK_TRUE, UINT64_MAX);
+			break;
+		}
+	}
+	RetireBatches(false);
+}
+
+bool UploadManager::HasTransferQueue() const
+{
+	return m_pGraphics->GetTransferQueueFamilyIndex() != m_pGraphics->GetQueueFamilyIndex();
+}
+
+RingAllocation UploadManager::AllocateStaging(std::unique_lock<std::mutex>& lock, const void* pData, VkDeviceSize size)
+{
+	assert(size <= m_pStagingRing->GetSize());
+
+	RingAllocation staging;
+	while (m_pStagingRing->TryAllocate(size, m_CopyAlignment, staging) == false)
+	{
+		if (std::this_thread::get_id() == m_SubmitThread)
+		{
+			Submit();
+			if (m_SubmittedBatches.size() > 0)
+			{
+				vkWaitForFences(m_pGraphics->GetDevice(), 1, &m_SubmittedBatches.front().Fence, VK_TRUE, UINT64_MAX);
+			}
+			RetireBatches(false);
+		}
+		else
+		{
+			m_StagingReleased.wait(lock);
+		}
+	}
+	memcpy(staging.pCpuPointer, pData, (size_t)size);
+	m_pStagingRing->Flush(staging);
+	return staging;
+}
+
+void UploadManager::AddBufferCopy(CopyList& list, VkBuffer target, const VkBufferCopy& region)
+{
+	if (list.Steps.empty())
+	{
+		list.Steps.emplace_back();
+	}
+
+	//Regions of one copy command can't overlap, writing the same bytes again needs a barrier in between
+	bool overlaps = false;
+	auto findTarget = [target](const std::pair<VkBuffer, std::vector<VkBufferCopy>>& copies) { return copies.first == target; };
+	std::vector<std::pair<VkBuffer, std::vector<VkBufferCopy>>>& bufferCopies = list.Steps.back().BufferCopies;
+	auto it = std::find_if(bufferCopies.begin(), bufferCopies.end(), findTarget);
+	if (it != bufferCopies.end())
+	{
+		for (const VkBufferCopy& other : it->second)
+		{
+			overlaps |= region.dstOffset < other.dstOffset + other.size && other.dstOffset < region.dstOffset + region.size;
+		}
+	}
+	if (overlaps)
+	{
+		list.Steps.emplace_back();
+	}
+
+	CopyStep& step = list.Steps.back();
+	it = std::find_if(step.BufferCopies.begin(), step.BufferCopies.end(), findTarget);
+	if (it == step.BufferCopies.end())
+	{
+		step.BufferCopies.push_back(std::make_pair(target, std::vector<VkBufferCopy>()));
+		it = step.BufferCopies.end() - 1;
+	}
+	it->second.push_back(region);
+}
+
+void UploadManager::AddImageCopy(CopyList& list, VkImage target, VkImageAspectFlags aspectMask, VkImageLayout oldLayout, bool firstChunk, const VkBufferImageCopy& region)
+{
+	auto findTarget = [target](const std::pair<VkImage, std::vector<VkBufferImageCopy>>& copies) { return copies.first == target; };
+	bool written = false;
+	bool writtenInStep = false;
+	for (const CopyStep& step : list.Steps)
+	{
+		writtenInStep = std::find_if(step.ImageCopies.begin(), step.ImageCopies.end(), findTarget) != step.ImageCopies.end();
+		written |= writtenInStep;
+	}
+	if (list.Steps.empty() || (firstChunk && writtenInStep))
+	{
+		list.Steps.emplace_back();
+	}
+
+	//An image written earlier in the batch is a transfer destination already
+	CopyStep& step = list.Steps.back();
+	if (firstChunk && written == false)
+	{
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.pNext = nullptr;
+		barrier.srcAccessMask = oldLayout == VK_IMAGE_LAYOUT_UNDEFINED ? 0 : VK_ACCESS_MEMORY_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = oldLayout;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = target;
+		barrier.subresourceRange.aspectMask = aspectMask;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+		step.ImageBarriers.push_back(barrier);
+	}
+
+	auto it = std::find_if(step.ImageCopies.begin(), step.ImageCopies.end(), findTarget);
+	if (it == step.ImageCopies.end())
+	{
+		step.ImageCopies.push_back(std::make_pair(target, std::vector<VkBufferImageCopy>()));
+		it = step.ImageCopies.end() - 1;
+	}
+	it->second.push_back(region);
+}
+
+void UploadManager::AddUsage(CopyList& list, ResourceUsage usage, VkAccessFlags& dstAccess) const
+{
+	const ResourceState& state = ResourceStateTracker::GetUsageState(usage);
+	if (state.Stages == 0)
+	{
+		dstAccess = VK_ACCESS_MEMORY_READ_BIT;
+		list.DstStages |= VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	}
+	else
+	{
+		dstAccess = state.Access;
+		list.DstStages |= state.Stages;
+	}
+}
+
+void UploadManager::RecordCopies(VkCommandBuffer commandBuffer, const CopyList& list) const
+{
+	VkBuffer source = m_pStagingRing->GetBuffer();
+	for (size_t i = 0; i < list.Steps.size(); ++i)
+	{
+		const CopyStep& step = list.Steps[i];
+
+		//Later steps write to targets of an earlier step again
+		VkMemoryBarrier memoryBarrier = {};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.pNext = nullptr;
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		uint32 memoryBarrierCount = i > 0 ? 1 : 0;
+		if (memoryBarrierCount > 0 || step.ImageBarriers.size() > 0)
+		{
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, memoryBarrierCount, &memoryBarrier, 0, nullptr, (uint32)step.ImageBarriers.size(), step.ImageBarriers.data());
+		}
+
+		for (const auto& copies : step.BufferCopies)
+		{
+			vkCmdCopyBuffer(commandBuffer, source, copies.first, (uint32)copies.second.size(), copies.second.data());
+		}
+		for (const auto& copies : step.ImageCopies)
+		{
+			vkCmdCopyBufferToImage(commandBuffer, source, copies.first, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32)copies.second.size(), copies.second.data());
+		}
+	}
+}
+
+void UploadManager::Submit()
+{
+	Batch& batch = m_CurrentBatch;
+	bool hasTransferCopies = batch.TransferCopies.Steps.size() > 0;
+	bool hasGraphicsCopies = batch.GraphicsCopies.Steps.size() > 0;
+	if (hasTransferCopies == false && hasGraphicsCopies == false)
+	{
+		return;
+	}
+
+	batch.Fence = m_pFencePool->Allocate();
+
+	CopyList& transferCopies = batch.TransferCopies;
+	if (hasTransferCopies)
+	{
+		batch.pTransferPool = AcquireCommandPool(m_TransferCommandPools, HasTransferQueue() ? m_pGraphics->GetTransferQueueFamilyIndex() : m_pGraphics->GetQueueFamilyIndex());
+		batch.pTransferCommands = batch.pTransferPool->Allocate();
+		batch.pTransferCommands->Begin();
+		RecordCopies(batch.pTransferCommands->GetBuffer(), transferCopies);
+
+		//Without a transfer queue this makes the copies visible, otherwise it releases ownership
+		VkPipelineStageFlags dstStage = HasTransferQueue() ? (VkPipelineStageFlags)VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : transferCopies.DstStages;
+		std::vector<VkBufferMemoryBarrier> bufferBarriers = transferCopies.BufferBarriers;
+		std::vector<VkImageMemoryBarrier> imageBarriers = transferCopies.ImageBarriers;
+		if (HasTransferQueue())
+		{
+			for (VkBufferMemoryBarrier& barrier : bufferBarriers)
+			{
+				barrier.dstAccessMask = 0;
+			}
+			for (VkImageMemoryBarrier& barrier : imageBarriers)
+			{
+				barrier.dstAccessMask = 0;
+			}
+		}
+		vkCmdPipelineBarrier(batch.pTransferCommands->GetBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, (uint32)bufferBarriers.size(), bufferBarriers.data(), (uint32)imageBarriers.size(), imageBarriers.data());
+		batch.pTransferCommands->End();
+
+		VkCommandBuffer buffer = batch.pTransferCommands->GetBuffer();
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = nullptr;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &buffer;
+		submitInfo.waitSemaphoreCount = 0;
+		if (HasTransferQueue())
+		{
+			batch.Semaphore = AcquireSemaphore();
+			submitInfo.signalSemaphoreCount = 1;
+			submitInfo.pSignalSemaphores = &batch.Semaphore;
+			VK_LOG(vkQueueSubmit(m_pGraphics->GetTransferQueue(), 1, &submitInfo, VK_NULL_HANDLE));
+		}
+		else
+		{
+			submitInfo.signalSemaphoreCount = 0;
+			VK_LOG(vkQueueSubmit(m_pGraphics->GetDeviceQueue(), 1, &submitInfo, batch.Fence));
+		}
+	}
+
+	if (batch.Semaphore != VK_NULL_HANDLE || hasGraphicsCopies)
+	{
+		batch.pGraphicsPool = AcquireCommandPool(m_GraphicsCommandPools, m_pGraphics->GetQueueFamilyIndex());
+		batch.pGraphicsCommands = batch.pGraphicsPool->Allocate();
+		batch.pGraphicsCommands->Begin();
+		VkCommandBuffer buffer = batch.pGraphicsCommands->GetBuffer();
+
+		//Acquire the released resources before the graphics queue touches them.
+		//Only the stages that use them wait for the semaphore, the acquire barrier chains to that wait
+		VkPipelineStageFlags waitStage = transferCopies.DstStages;
+		if (batch.Semaphore != VK_NULL_HANDLE)
+		{
+			for (VkBufferMemoryBarrier& barrier : transferCopies.BufferBarriers)
+			{
+				barrier.srcAccessMask = 0;
+			}
+			for (VkImageMemoryBarrier& barrier : transferCopies.ImageBarriers)
+			{
+				barrier.srcAccessMask = 0;
+			}
+			vkCmdPipelineBarrier(buffer, waitStage, waitStage, 0, 0, nullptr, (uint32)transferCopies.BufferBarriers.size(), transferCopies.BufferBarriers.data(), (uint32)transferCopies.ImageBarriers.size(), transferCopies.ImageBarriers.data());
+		}
+		if (hasGraphicsCopies)
+		{
+			CopyList& graphicsCopies = batch.GraphicsCopies;
+			RecordCopies(buffer, graphicsCopies);
+			vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, graphicsCopies.DstStages, 0, 0, nullptr, (uint32)graphicsCopies.BufferBarriers.size(), graphicsCopies.BufferBarriers.data(), (uint32)graphicsCopies.ImageBarriers.size(), graphicsCopies.ImageBarriers.data());
+		}
+		batch.pGraphicsCommands->End();
+
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = nullptr;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &buffer;
+		submitInfo.signalSemaphoreCount = 0;
+		submitInfo.waitSemaphoreCount = batch.Semaphore != VK_NULL_HANDLE ? 1 : 0;
+		submitInfo.pWaitSemaphores = &batch.Semaphore;
+		submitInfo.pWaitDstStageMask = &waitStage;
+		VK_LOG(vkQueueSubmit(m_pGraphics->GetDeviceQueue(), 1, &submitInfo, batch.Fence));
+	}
+
+	m_pStagingRing->EndSegment(batch.Token);
+
+	uint64 nextToken = batch.Token + 1;
+	m_SubmittedBatches.push_back(std::move(batch));
+	m_CurrentBatch = Batch();
+	m_CurrentBatch.Token = nextToken;
+}
+
+void UploadManager::RetireBatches(bool wait)
+{
+	uint64 completedToken = m_CompletedToken;
+	while (m_SubmittedBatches.size() > 0)
+	{
+		Batch& batch = m_SubmittedBatches.front();
+		if (wait)
+		{
+			vkWaitForFences(m_pGraphics->GetDevice(), 1, &batch.Fence, VK_TRUE, UINT64_MAX);
+		}
+		else if (vkGetFenceStatus(m_pGraphics->GetDevice(), batch.Fence) != VK_SUCCESS)
+		{
+			break;
+		}
+		m_CompletedToken = batch.Token;
+		ReleaseBatch(batch);
+		m_SubmittedBatches.pop_front();
+	}
+	//Batches without uploads are never submitted
+	if (m_SubmittedBatches.empty())
+	{
+		m_CompletedToken = m_CurrentBatch.Token - 1;
+	}
+
+	if (m_CompletedToken != completedToken)
+	{
+		m_pStagingRing->Retire(m_CompletedToken);
+		m_StagingReleased.notify_all();
+	}
+}
+
+std::unique_ptr<CommandBufferPool> UploadManager::AcquireCommandPool(std::vector<std::unique_ptr<CommandBufferPool>>& freePools, uint32 queueFamilyIndex)
+{
+	if (freePools.size() > 0)
+	{
+		std::unique_ptr<CommandBufferPool> pPool = std::move(freePools.back());
+		freePools.pop_back();
+		return pPool;
+	}
+	return std::make_unique<CommandBufferPool>(m_pGraphics, queueFamilyIndex);
+}
+
+VkSemaphore UploadManager::AcquireSemaphore()
+{
+	//A semaphore can be reused once the wait on it has finished, which the batch fence guarantees
+	if (m_FreeSemaphores.size() > 0)
+	{
+		VkSemaphore semaphore = m_FreeSemaphores.back();
+		m_FreeSemaphores.pop_back();
+		return semaphore;
+	}
+	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreCreateInfo.pNext = nullptr;
+	semaphoreCreateInfo.flags = 0;
+	VkSemaphore semaphore;
+	VK_LOG(vkCreateSemaphore(m_pGraphics->GetDevice(), &semaphoreCreateInfo, nullptr, &semaphore));
+	m_Semaphores.push_back(semaphore);
+	return semaphore;
+}
+
+void UploadManager::ReleaseBatch(Batch& batch)
+{
+	//Giving the only buffer back resets the pool
+	if (batch.pTransferPool)
+	{
+		batch.pTransferPool->Free(batch.pTransferCommands);
+		m_TransferCommandPools.push_back(std::move(batch.pTransferPool));
+	}
+	if (batch.pGraphicsPool)
+	{
+		batch.pGraphicsPool->Free(batch.pGraphicsCommands);
+		m_GraphicsCommandPools.push_back(std::move(batch.pGraphicsPool));
+	}
+	m_pFencePool->Free(batch.Fence);
+	if (batch.Semaphore != VK_NULL_HANDLE)
+	{
+		m_FreeSemaphores.push_back(batch.Semaphore);
+	}
+}
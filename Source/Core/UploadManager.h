@@ -0,0 +1,113 @@
+#pragma once
+#include "RingAllocator.h"
+#include "ResourceStateTracker.h"
+class Graphics;
+class CommandBuffer;
+class CommandBufferPool;
+class FencePool;
+
+//Records buffer and image uploads on the transfer queue and submits them together in a batch.
+//Uploads return the token of their batch, Flush submits the batch and must be called on the thread
+//that submits to the graphics queue before the uploaded resources are used.
+//With a dedicated transfer queue family the resources are released on the transfer queue and
+//acquired on the graphics queue, which waits for the copies with a semaphore.
+//Data is staged in a persistently mapped ring, large uploads are split into chunks.
+//When the ring is full, the submitting thread makes room itself and other threads wait for the next Flush.
+//Copies are collected and recorded at submit, each target gets one copy command and the layout
+//transitions of all targets are merged into one barrier before and one after the copies.
+//The barrier after the copies only waits in the stages of the usage the targets are uploaded for.
+class UploadManager
+{
+public:
+	UploadManager(Graphics* pGraphics, VkDeviceSize stagingSize);
+	~UploadManager();
+
+	//'usage' is what the buffer is read as afterwards, undefined makes the copy visible to every stage.
+	//'preserveContents' keeps the rest of the buffer intact for partial updates
+	uint64 UploadBuffer(VkBuffer target, ResourceUsage usage, const void* pData, VkDeviceSize size, VkDeviceSize offset = 0, bool preserveContents = false);
+	//The image is transitioned from its tracked layout to the layout of 'usage', an untracked or undefined image loses its contents
+	uint64 UploadImage(VkImage target, ResourceUsage usage, VkImageAspectFlags aspectMask, uint32 mipLevel, int x, int y, uint32 width, uint32 height, const void* pData, VkDeviceSize size);
+
+	//A scope on the submitting thread keeps Flush from submitting until it ends so everything loaded in between goes out in one submit.
+	//Scopes of other threads don't hold back Flush, it would stall the uploads of every thread and a full staging ring would never drain.
+	//Scopes are per thread and can be nested, EndBatch returns the token of the batch that has the last uploads of the scope
+	void BeginBatch();
+	uint64 EndBatch();
+
+	//Submits the pending uploads and releases the staging memory of finished batches
+	void Flush();
+	bool IsComplete(uint64 token) const { return token <= m_CompletedToken; }
+	//Blocks until the batch has finished, submits it first if needed so it has the same threading rules as Flush
+	void Wait(uint64 token);
+
+private:
+	//Copies that can be recorded without barriers in between
+	struct CopyStep
+	{
+		std::vector<VkImageMemoryBarrier> ImageBarriers;
+		std::vector<std::pair<VkBuffer, std::vector<VkBufferCopy>>> BufferCopies;
+		std::vector<std::pair<VkImage, std::vector<VkBufferImageCopy>>> ImageCopies;
+	};
+
+	struct CopyList
+	{
+		//A new step starts when a target is written twice
+		std::vector<CopyStep> Steps;
+		//Transitions after the copies, with a transfer queue these release ownership to the graphics queue
+		std::vector<VkBufferMemoryBarrier> BufferBarriers;
+		std::vector<VkImageMemoryBarrier> ImageBarriers;
+		//Stages of the usages that wait for the copies
+		VkPipelineStageFlags DstStages = 0;
+	};
+
+	struct Batch
+	{
+		uint64 Token = 0;
+		CopyList TransferCopies;
+		//Updates of contents that are owned by the graphics queue, recorded there to avoid an ownership round trip
+		CopyList GraphicsCopies;
+		std::unique_ptr<CommandBufferPool> pTransferPool;
+		std::unique_ptr<CommandBufferPool> pGraphicsPool;
+		CommandBuffer* pTransferCommands = nullptr;
+		CommandBuffer* pGraphicsCommands = nullptr;
+		VkSemaphore Semaphore = VK_NULL_HANDLE;
+		VkFence Fence = VK_NULL_HANDLE;
+	};
+
+	bool HasTransferQueue() const;
+	RingAllocation AllocateStaging(std::unique_lock<std::mutex>& lock, const void* pData, VkDeviceSize size);
+	void AddBufferCopy(CopyList& list, VkBuffer target, const VkBufferCopy& region);
+	//Only the first chunk of an upload transitions the image, the others continue the same upload
+	void AddImageCopy(CopyList& list, VkImage target, VkImageAspectFlags aspectMask, VkImageLayout oldLayout, bool firstChunk, const VkBufferImageCopy& region);
+	void AddUsage(CopyList& list, ResourceUsage usage, VkAccessFlags& dstAccess) const;
+	void RecordCopies(VkCommandBuffer commandBuffer, const CopyList& list) const;
+	std::unique_ptr<CommandBufferPool> AcquireCommandPool(std::vector<std::unique_ptr<CommandBufferPool>>& freePools, uint32 queueFamilyIndex);
+	VkSemaphore AcquireSemaphore();
+	void Submit();
+	void RetireBatches(bool wait);
+	void ReleaseBatch(Batch& batch);
+
+	Graphics* m_pGraphics;
+	std::mutex m_Mutex;
+	std::condition_variable m_StagingReleased;
+	std::thread::id m_SubmitThread;
+	std::map<std::thread::id, uint32> m_BatchDepths;
+
+	//Keeps a few chunks in flight so waiting for one frees up space
+	static const uint32 MAX_CHUNKS_PER_RING = 4;
+	std::unique_ptr<RingAllocator> m_pStagingRing;
+	VkDeviceSize m_MaxChunkSize = 0;
+	VkDeviceSize m_CopyAlignment = 0;
+
+	//Every batch records into its own pools so their buffers are reset at once when the batch retires.
+	//Pools, fences and semaphores are recycled, submitting creates no Vulkan objects once warmed up
+	std::vector<std::unique_ptr<CommandBufferPool>> m_TransferCommandPools;
+	std::vector<std::unique_ptr<CommandBufferPool>> m_GraphicsCommandPools;
+	std::unique_ptr<FencePool> m_pFencePool;
+	std::vector<VkSemaphore> m_Semaphores;
+	std::vector<VkSemaphore> m_FreeSemaphores;
+
+	Batch m_CurrentBatch;
+	std::deque<Batch> m_SubmittedBatches;
+	uint64 m_CompletedToken = 0;
+};
@@ -2,25 +2,175 @@
 #include "VulkanAllocator.h"
 #include "Graphics.h"
 
-VulkanAllocator::VulkanAllocator(VkPhysicalDevice physicalDevice, VkDevice device) :
-	m_Device(device)
+struct ThreadCache
 {
+	std::array<AllocationChunk*, VK_MAX_MEMORY_TYPES> Chunks = {};
+};
+
+namespace
+{
+	std::atomic<uint32> g_AllocatorCount(0);
+
+	class DeviceMemoryBackend : public MemoryBackend
+	{
+	public:
+		DeviceMemoryBackend(VkDevice device) :
+			m_Device(device)
+		{}
+
+		virtual bool AllocateMemory(uint32 memoryTypeIndex, VkDeviceSize size, bool map, const void* pNext, VkDeviceMemory& memory, void*& pCpuPointer) override
+		{
+			VkMemoryAllocateInfo allocateInfo = {};
+			allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			allocateInfo.pNext = pNext;
+			allocateInfo.allocationSize = size;
+			allocateInfo.memoryTypeIndex = memoryTypeIndex;
+			if (vkAllocateMemory(m_Device, &allocateInfo, nullptr, &memory) != VK_SUCCESS)
+			{
+				memory = VK_NULL_HANDLE;
+				return false;
+			}
+			pCpuPointer = nullptr;
+			if (map)
+			{
+				vkMapMemory(m_Device, memory, 0, size, 0, &pCpuPointer);
+			}
+			return true;
+		}
+
+		virtual void FreeMemory(VkDeviceMemory memory, void* pCpuPointer) override
+		{
+			if (pCpuPointer != nullptr)
+			{
+				vkUnmapMemory(m_Device, memory);
+			}
+			vkFreeMemory(m_Device, memory, nullptr);
+		}
+
+	private:
+		VkDevice m_Device;
+	};
+
+	//Allocator id to the calling thread's cache of that allocator
+	thread_local std::map<uint32, ThreadCache*> t_ThreadCaches;
+
+	int CountBits(uint32 value)
+	{
+		int count = 0;
+		for (; value != 0; value &= value - 1)
+		{
+			++count;
+		}
+		return count;
+	}
+
+	void WriteMemoryFlags(std::ostream& stream, VkMemoryPropertyFlags flags)
+	{
+		const std::pair<VkMemoryPropertyFlags, const char*> names[] = {
+			{ VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "DEVICE_LOCAL" },
+			{ VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, "HOST_VISIBLE" },
+			{ VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, "HOST_COHERENT" },
+			{ VK_MEMORY_PROPERTY_HOST_CACHED_BIT, "HOST_CACHED" },
+			{ VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, "LAZILY_ALLOCATED" },
+		};
+		stream << "[";
+		bool first = true;
+		for (const auto& name : names)
+		{
+			if (flags & name.first)
+			{
+				stream << (first ? "" : ", ") << "\"" << name.second << "\"";
+				first = false;
+			}
+		}
+		stream << "]";
+	}
+
+	void WriteMemoryStatistics(std::ostream& stream, const MemoryStatistics& statistics)
+	{
+		stream << "{ \"ReservedBytes\": " << statistics.ReservedBytes;
+		stream << ", \"UsedBytes\": " << statistics.UsedBytes;
+		stream << ", \"LargestFreeRange\": " << statistics.LargestFreeRange;
+		stream << ", \"Fragmentation\": " << statistics.GetFragmentation();
+		stream << ", \"BlockCount\": " << statistics.BlockCount;
+		stream << ", \"AllocationCount\": " << statistics.AllocationCount;
+		stream << ", \"DedicatedAllocationCount\": " << statistics.DedicatedAllocationCount << " }";
+	}
+}
+
+const VulkanAllocator::MemoryUsageInfo VulkanAllocator::MEMORY_USAGES[(int)MemoryUsage::MAX] =
+{
+	//GpuOnly, falls back to system memory when VRAM is full
+	{ VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, MemoryUsage::CpuToGpu },
+	//CpuToGpu, write combined system memory
+	{ VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, MemoryUsage::MAX },
+	//GpuToCpu, cached so reading it back is fast
+	{ VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryUsage::MAX },
+	//CpuToGpuDeviceLocal, the host visible part of VRAM (or all of it with resizable BAR)
+	{ VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0, VK_MEMORY_PROPERTY_HOST_CACHED_BIT, MemoryUsage::CpuToGpu },
+};
+
+float MemoryStatistics::GetFragmentation() const
+{
+	//Dedicated memory is always fully used so the free bytes are all in blocks
+	VkDeviceSize freeBytes = ReservedBytes - UsedBytes;
+	if (freeBytes == 0)
+	{
+		return 0.0f;
+	}
+	return 1.0f - (float)LargestFreeRange / freeBytes;
+}
+
+void MemoryStatistics::Add(const MemoryStatistics& other)
+{
+	ReservedBytes += other.ReservedBytes;
+	UsedBytes += other.UsedBytes;
+	LargestFreeRange = std::max(LargestFreeRange, other.LargestFreeRange);
+	BlockCount += other.BlockCount;
+	AllocationCount += other.AllocationCount;
+	DedicatedAllocationCount += other.DedicatedAllocationCount;
+}
+
+VulkanAllocator::VulkanAllocator(VkPhysicalDevice physicalDevice, VkDevice device, bool dedicatedAllocationSupported, bool memoryBudgetSupported) :
+	m_PhysicalDevice(physicalDevice), m_Device(device), m_DedicatedAllocationSupported(dedicatedAllocationSupported), m_MemoryBudgetSupported(memoryBudgetSupported)
+{
+	m_Id = g_AllocatorCount++;
+	m_OwnerThread = std::this_thread::get_id();
+	m_pBackend = std::make_unique<DeviceMemoryBackend>(device);
 	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_DeviceMemoryProperties);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	m_BufferImageGranularity = properties.limits.bufferImageGranularity;
+	m_NonCoherentAtomSize = properties.limits.nonCoherentAtomSize;
+	m_ChunkAlignment = std::max<VkDeviceSize>(m_BufferImageGranularity, 256);
+
+	if (m_DedicatedAllocationSupported)
+	{
+		m_pGetBufferMemoryRequirements2 = (PFN_vkGetBufferMemoryRequirements2KHR)vkGetDeviceProcAddr(m_Device, "vkGetBufferMemoryRequirements2KHR");
+		m_pGetImageMemoryRequirements2 = (PFN_vkGetImageMemoryRequirements2KHR)vkGetDeviceProcAddr(m_Device, "vkGetImageMemoryRequirements2KHR");
+		m_DedicatedAllocationSupported = m_pGetBufferMemoryRequirements2 != nullptr && m_pGetImageMemoryRequirements2 != nullptr;
+	}
 }
 
 VulkanAllocator::~VulkanAllocator()
 {
-	for (auto& pair : m_MemoryPools)
+	for (auto& pCache : m_ThreadCaches)
 	{
-		if (pair.second.Memory != VK_NULL_HANDLE)
+		for (AllocationChunk* pChunk : pCache->Chunks)
 		{
-			if (pair.second.CpuVisible)
+			if (pChunk != nullptr)
 			{
-				vkUnmapMemory(m_Device, pair.second.Memory);
+				ReleaseChunk(pChunk);
 			}
-			vkFreeMemory(m_Device, pair.second.Memory, nullptr);
 		}
 	}
+	m_ThreadCaches.clear();
+
+	for (auto& pair : m_MemoryPools)
+	{
+		pair.second.DestroyBlocks(*m_pBackend);
+	}
 }
 
 bool VulkanAllocator::MemoryTypeFromProperties(uint32_t typeBits, VkFlags requirements_mask, uint32_t *typeIndex)
@@ -43,52 +193,710 @@ bool VulkanAllocator::MemoryTypeFromProperties(uint32_t typeBits, VkFlags requir
 	return false;
 }
 
-VulkanAllocation VulkanAllocator::Allocate(VkImage image, bool cpuVisible)
+VulkanAllocation VulkanAllocator::Allocate(VkImage image, MemoryUsage usage, bool dedicated)
 {
 	VkMemoryRequirements requirements;
-	vkGetImageMemoryRequirements(m_Device, image, &requirements);
+	if (m_DedicatedAllocationSupported)
+	{
+		VkMemoryDedicatedRequirementsKHR dedicatedRequirements = {};
+		dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS_KHR;
+		dedicatedRequirements.pNext = nullptr;
 
-	return Allocate(requirements, cpuVisible);
+		VkMemoryRequirements2KHR requirements2 = {};
+		requirements2.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2_KHR;
+		requirements2.pNext = &dedicatedRequirements;
+
+		VkImageMemoryRequirementsInfo2KHR info = {};
+		info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2_KHR;
+		info.pNext = nullptr;
+		info.image = image;
+		m_pGetImageMemoryRequirements2(m_Device, &info, &requirements2);
+
+		requirements = requirements2.memoryRequirements;
+		dedicated |= dedicatedRequirements.requiresDedicatedAllocation == VK_TRUE || dedicatedRequirements.prefersDedicatedAllocation == VK_TRUE;
+	}
+	else
+	{
+		vkGetImageMemoryRequirements(m_Device, image, &requirements);
+	}
+	MemoryPool::AlignToGranularity(requirements, m_BufferImageGranularity);
+
+	return Allocate(requirements, usage, dedicated, image, VK_NULL_HANDLE);
 }
 
-VulkanAllocation VulkanAllocator::Allocate(VkBuffer buffer, bool cpuVisible)
+VulkanAllocation VulkanAllocator::Allocate(VkBuffer buffer, MemoryUsage usage, bool dedicated)
 {
 	VkMemoryRequirements requirements;
-	vkGetBufferMemoryRequirements(m_Device, buffer, &requirements);
+	if (m_DedicatedAllocationSupported)
+	{
+		VkMemoryDedicatedRequirementsKHR dedicatedRequirements = {};
+		dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS_KHR;
+		dedicatedRequirements.pNext = nullptr;
+
+		VkMemoryRequirements2KHR requirements2 = {};
+		requirements2.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2_KHR;
+		requirements2.pNext = &dedicatedRequirements;
+
+		VkBufferMemoryRequirementsInfo2KHR info = {};
+		info.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2_KHR;
+		info.pNext = nullptr;
+		info.buffer = buffer;
+		m_pGetBufferMemoryRequirements2(m_Device, &info, &requirements2);
 
-	return Allocate(requirements, cpuVisible);
+		requirements = requirements2.memoryRequirements;
+		dedicated |= dedicatedRequirements.requiresDedicatedAllocation == VK_TRUE || dedicatedRequirements.prefersDedicatedAllocation == VK_TRUE;
+	}
+	else
+	{
+		vkGetBufferMemoryRequirements(m_Device, buffer, &requirements);
+	}
+
+	return Allocate(requirements, usage, dedicated, VK_NULL_HANDLE, buffer);
 }
 
-VulkanAllocation VulkanAllocator::Allocate(VkMemoryRequirements& requirements, bool cpuVisible)
+VulkanAllocation VulkanAllocator::AllocateMemory(const VkMemoryRequirements& requirements, MemoryUsage usage, bool dedicated)
 {
-	uint32 index = 0;
-	MemoryTypeFromProperties(requirements.memoryTypeBits, cpuVisible ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &index);
+	return Allocate(requirements, usage, dedicated, VK_NULL_HANDLE, VK_NULL_HANDLE);
+}
 
-	MemoryPool& pool = m_MemoryPools[index];
-	if (pool.Memory == VK_NULL_HANDLE)
+VulkanAllocation VulkanAllocator::Allocate(const VkMemoryRequirements& requirements, MemoryUsage usage, bool dedicated, VkImage image, VkBuffer buffer)
+{
+	//Walk down the fallback chain until a memory type has room
+	VulkanAllocation allocation;
+	for (MemoryUsage currentUsage = usage; currentUsage != MemoryUsage::MAX; currentUsage = MEMORY_USAGES[(int)currentUsage].Fallback)
 	{
-		pool.TypeBits = index;
-		pool.CurrentOffset = 0;
-		VkMemoryAllocateInfo allocateInfo = {};
-		allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocateInfo.pNext = nullptr;
-		allocateInfo.allocationSize = POOL_SIZE;
-		allocateInfo.memoryTypeIndex = index;
-		vkAllocateMemory(m_Device, &allocateInfo, nullptr, &pool.Memory);
-		pool.CpuVisible = cpuVisible;
-		if (pool.CpuVisible)
+		uint32 index = 0;
+		if (FindMemoryType(requirements.memoryTypeBits, currentUsage, index) == false)
+		{
+			continue;
+		}
+
+		if (dedicated == false && requirements.size <= SMALL_ALLOCATION_SIZE && std::this_thread::get_id() != m_OwnerThread)
+		{
+			if (AllocateFromThreadCache(index, requirements, allocation))
+			{
+				return allocation;
+			}
+			//Falls back to the pool
+		}
+
+		std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+		MemoryPool& pool = GetMemoryPool(index);
+		if (dedicated || pool.NeedsDedicatedMemory(requirements.size))
+		{
+			if (AllocateDedicated(requirements, index, image, buffer, allocation))
+			{
+				return allocation;
+			}
+		}
+		else if (AllocateFromPool(pool, requirements, allocation))
 		{
-			vkMapMemory(m_Device, pool.Memory, 0, POOL_SIZE, 0, &pool.pCpuPointer);
+			return allocation;
 		}
 	}
-	VulkanAllocation allocation(pool, requirements.size);
-	int desiredSize = (requirements.size + requirements.alignment - 1) & ~(requirements.alignment - 1);
-	pool.CurrentOffset += desiredSize;
-	++pool.Allocations;
+
+	std::cout << "Out of memory! Failed to allocate " << requirements.size << " bytes for memory usage " << (int)usage << std::endl;
+	abort();
 	return allocation;
 }
 
+bool VulkanAllocator::AllocateFromPool(MemoryPool& pool, const VkMemoryRequirements& requirements, VulkanAllocation& allocation)
+{
+	MemoryBlock* pBlock = pool.Allocate(*m_pBackend, requirements, m_FrameIndex, allocation.Offset, allocation.Handle);
+	if (pBlock == nullptr)
+	{
+		return false;
+	}
+	InitializeAllocation(pool, pBlock, requirements, allocation);
+	return true;
+}
+
+bool VulkanAllocator::AllocateFromThreadCache(uint32 memoryTypeIndex, const VkMemoryRequirements& requirements, VulkanAllocation& allocation)
+{
+	//Offsets are aligned relative to the chunk, that is only aligned relative to the memory object up to the chunk alignment
+	if (requirements.alignment > m_ChunkAlignment)
+	{
+		return false;
+	}
+
+	ThreadCache* pCache = GetThreadCache();
+	AllocationChunk* pChunk = pCache->Chunks[memoryTypeIndex];
+	VkDeviceSize offset = 0;
+	uint32 handle = TLSFAllocator::INVALID_HANDLE;
+	if (pChunk != nullptr && AllocateFromChunk(pChunk, requirements, offset, handle) == false)
+	{
+		ReleaseChunk(pChunk);
+		pChunk = nullptr;
+	}
+	if (pChunk == nullptr)
+	{
+		pChunk = CreateChunk(memoryTypeIndex);
+		pCache->Chunks[memoryTypeIndex] = pChunk;
+		if (pChunk == nullptr || AllocateFromChunk(pChunk, requirements, offset, handle) == false)
+		{
+			return false;
+		}
+	}
+
+	offset += pChunk->Offset;
+	allocation.Memory = pChunk->pBlock->Memory;
+	allocation.Offset = offset;
+	allocation.Size = requirements.size;
+	allocation.pCpuPointer = pChunk->pBlock->pCpuPointer != nullptr ? (char*)pChunk->pBlock->pCpuPointer + offset : nullptr;
+	allocation.MemoryTypeIndex = memoryTypeIndex;
+	allocation.pBlock = pChunk->pBlock;
+	allocation.pChunk = pChunk;
+	allocation.Handle = handle;
+	return true;
+}
+
+ThreadCache* VulkanAllocator::GetThreadCache()
+{
+	auto it = t_ThreadCaches.find(m_Id);
+	if (it != t_ThreadCaches.end())
+	{
+		return it->second;
+	}
+
+	std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+	m_ThreadCaches.push_back(std::make_unique<ThreadCache>());
+	t_ThreadCaches[m_Id] = m_ThreadCaches.back().get();
+	return m_ThreadCaches.back().get();
+}
+
+void VulkanAllocator::ReleaseThreadCache()
+{
+	auto it = t_ThreadCaches.find(m_Id);
+	if (it == t_ThreadCaches.end())
+	{
+		return;
+	}
+	ThreadCache* pCache = it->second;
+	t_ThreadCaches.erase(it);
+
+	for (AllocationChunk* pChunk : pCache->Chunks)
+	{
+		if (pChunk != nullptr)
+		{
+			ReleaseChunk(pChunk);
+		}
+	}
+
+	std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+	for (size_t i = 0; i < m_ThreadCaches.size(); ++i)
+	{
+		if (m_ThreadCaches[i].get() == pCache)
+		{
+			m_ThreadCaches.erase(m_ThreadCaches.begin() + i);
+			break;
+		}
+	}
+}
+
+AllocationChunk* VulkanAllocator::CreateChunk(uint32 memoryTypeIndex)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+
+	VkMemoryRequirements requirements;
+	requirements.size = CHUNK_SIZE;
+	requirements.alignment = m_ChunkAlignment;
+	requirements.memoryTypeBits = 1u << memoryTypeIndex;
+
+	//Not traced, the allocations in the chunk are
+	MemoryPool& pool = GetMemoryPool(memoryTypeIndex);
+	VkDeviceSize offset = 0;
+	uint32 handle = TLSFAllocator::INVALID_HANDLE;
+	MemoryBlock* pBlock = pool.Allocate(*m_pBackend, requirements, m_FrameIndex, offset, handle);
+	if (pBlock == nullptr)
+	{
+		return nullptr;
+	}
+
+	AllocationChunk* pChunk = new AllocationChunk();
+	pChunk->pBlock = pBlock;
+	pChunk->Handle = handle;
+	pChunk->Offset = offset;
+	pChunk->Size = CHUNK_SIZE;
+	pChunk->pAllocator = std::make_unique<TLSFAllocator>(CHUNK_SIZE);
+	pChunk->References = 1;
+	m_Chunks.push_back(pChunk);
+	return pChunk;
+}
+
+bool VulkanAllocator::AllocateFromChunk(AllocationChunk* pChunk, const VkMemoryRequirements& requirements, VkDeviceSize& offset, uint32& handle)
+{
+	std::lock_guard<std::mutex> lock(pChunk->Mutex);
+	if (pChunk->pAllocator->Allocate(requirements.size, requirements.alignment, offset, handle) == false)
+	{
+		return false;
+	}
+	//Traced under the chunk lock so the free of a reused range is always written first
+	TraceAllocate(pChunk->pBlock->Memory, pChunk->Offset + offset, requirements);
+	++pChunk->References;
+	return true;
+}
+
+void VulkanAllocator::FreeFromChunk(AllocationChunk* pChunk, uint32 handle)
+{
+	{
+		std::lock_guard<std::mutex> lock(pChunk->Mutex);
+		TraceFree(pChunk->pBlock->Memory, pChunk->Offset + pChunk->pAllocator->GetAllocationOffset(handle));
+		pChunk->pAllocator->Free(handle);
+	}
+	ReleaseChunk(pChunk);
+}
+
+void VulkanAllocator::ReleaseChunk(AllocationChunk* pChunk)
+{
+	if (--pChunk->References == 0)
+	{
+		std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+		FreeFromBlock(pChunk->pBlock, pChunk->Handle);
+		m_Chunks.erase(std::find(m_Chunks.begin(), m_Chunks.end(), pChunk));
+		delete pChunk;
+	}
+}
+
+bool VulkanAllocator::AllocateFromBlock(MemoryPool& pool, MemoryBlock* pBlock, const VkMemoryRequirements& requirements, VulkanAllocation& allocation)
+{
+	if (pBlock->pAllocator->Allocate(requirements.size, requirements.alignment, allocation.Offset, allocation.Handle) == false)
+	{
+		return false;
+	}
+	InitializeAllocation(pool, pBlock, requirements, allocation);
+	return true;
+}
+
+void VulkanAllocator::InitializeAllocation(MemoryPool& pool, MemoryBlock* pBlock, const VkMemoryRequirements& requirements, VulkanAllocation& allocation)
+{
+	TraceAllocate(pBlock->Memory, allocation.Offset, requirements);
+	allocation.Memory = pBlock->Memory;
+	allocation.Size = requirements.size;
+	allocation.pCpuPointer = pool.CpuVisible ? (char*)pBlock->pCpuPointer + allocation.Offset : nullptr;
+	allocation.MemoryTypeIndex = pBlock->MemoryTypeIndex;
+	allocation.pBlock = pBlock;
+}
+
+VulkanAllocation VulkanAllocator::Reallocate(VkImage image, const VulkanAllocation& current)
+{
+	VkMemoryRequirements requirements;
+	vkGetImageMemoryRequirements(m_Device, image, &requirements);
+	MemoryPool::AlignToGranularity(requirements, m_BufferImageGranularity);
+	return Reallocate(requirements, current);
+}
+
+VulkanAllocation VulkanAllocator::Reallocate(VkBuffer buffer, const VulkanAllocation& current)
+{
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(m_Device, buffer, &requirements);
+	return Reallocate(requirements, current);
+}
+
+VulkanAllocation VulkanAllocator::Reallocate(VkMemoryRequirements& requirements, const VulkanAllocation& current)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+	VulkanAllocation allocation;
+	if (current.pBlock == nullptr || (requirements.memoryTypeBits & (1u << current.pBlock->MemoryTypeIndex)) == 0)
+	{
+		return allocation;
+	}
+	MemoryPool& pool = m_MemoryPools[current.pBlock->MemoryTypeIndex];
+
+	//Pack into the fullest blocks first so the sparse ones drain
+	std::vector<MemoryBlock*> candidates;
+	for (auto& pBlock : pool.Blocks)
+	{
+		if (pBlock.get() != current.pBlock && pBlock->pAllocator->IsEmpty() == false)
+		{
+			candidates.push_back(pBlock.get());
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [](MemoryBlock* a, MemoryBlock* b) { return a->pAllocator->GetUsedSize() > b->pAllocator->GetUsedSize(); });
+
+	for (MemoryBlock* pBlock : candidates)
+	{
+		if (AllocateFromBlock(pool, pBlock, requirements, allocation))
+		{
+			break;
+		}
+	}
+	return allocation;
+}
+
+void VulkanAllocator::SetOwner(const VulkanAllocation& allocation, RelocatableResource* pOwner)
+{
+	if (allocation.pChunk != nullptr)
+	{
+		std::lock_guard<std::mutex> lock(allocation.pChunk->Mutex);
+		allocation.pChunk->pAllocator->SetUserData(allocation.Handle, pOwner);
+	}
+	else if (allocation.pBlock != nullptr)
+	{
+		std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+		allocation.pBlock->pAllocator->SetUserData(allocation.Handle, pOwner);
+	}
+}
+
+void VulkanAllocator::GetOwners(const MemoryBlock* pBlock, std::vector<std::pair<RelocatableResource*, VkDeviceSize>>& owners) const
+{
+	std::vector<uint32> handles;
+	pBlock->pAllocator->GetAllocations(handles);
+	for (uint32 handle : handles)
+	{
+		RelocatableResource* pOwner = (RelocatableResource*)pBlock->pAllocator->GetUserData(handle);
+		if (pOwner != nullptr)
+		{
+			owners.emplace_back(pOwner, pBlock->pAllocator->GetAllocationSize(handle));
+		}
+	}
+
+	//The chunks of a block are only created and released under the allocator lock
+	for (AllocationChunk* pChunk : m_Chunks)
+	{
+		if (pChunk->pBlock != pBlock)
+		{
+			continue;
+		}
+		std::lock_guard<std::mutex> lock(pChunk->Mutex);
+		handles.clear();
+		pChunk->pAllocator->GetAllocations(handles);
+		for (uint32 handle : handles)
+		{
+			RelocatableResource* pOwner = (RelocatableResource*)pChunk->pAllocator->GetUserData(handle);
+			if (pOwner != nullptr)
+			{
+				owners.emplace_back(pOwner, pChunk->pAllocator->GetAllocationSize(handle));
+			}
+		}
+	}
+}
+
+bool VulkanAllocator::AllocateDedicated(const VkMemoryRequirements& requirements, uint32 memoryTypeIndex, VkImage image, VkBuffer buffer, VulkanAllocation& allocation)
+{
+	VkMemoryDedicatedAllocateInfoKHR dedicatedInfo = {};
+	dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO_KHR;
+	dedicatedInfo.pNext = nullptr;
+	dedicatedInfo.image = image;
+	dedicatedInfo.buffer = buffer;
+
+	allocation = VulkanAllocation();
+	if (m_pBackend->AllocateMemory(memoryTypeIndex, requirements.size, m_MemoryPools[memoryTypeIndex].CpuVisible, m_DedicatedAllocationSupported ? &dedicatedInfo : nullptr, allocation.Memory, allocation.pCpuPointer) == false)
+	{
+		return false;
+	}
+	allocation.Offset = 0;
+	allocation.Size = requirements.size;
+	allocation.MemoryTypeIndex = memoryTypeIndex;
+	allocation.Dedicated = true;
+
+	++m_DedicatedAllocationCounts[memoryTypeIndex];
+	m_DedicatedAllocationBytes[memoryTypeIndex] += requirements.size;
+	return true;
+}
+
+bool VulkanAllocator::FindMemoryType(uint32 memoryTypeBits, MemoryUsage usage, uint32& memoryTypeIndex) const
+{
+	//Pick the type with all required flags that misses the fewest preferred flags and has the fewest unwanted ones
+	const MemoryUsageInfo& info = MEMORY_USAGES[(int)usage];
+	bool found = false;
+	int lowestCost = 0;
+	for (uint32 i = 0; i < m_DeviceMemoryProperties.memoryTypeCount; ++i)
+	{
+		VkMemoryPropertyFlags flags = m_DeviceMemoryProperties.memoryTypes[i].propertyFlags;
+		if ((memoryTypeBits & (1u << i)) == 0 || (flags & info.Required) != info.Required)
+		{
+			continue;
+		}
+		int cost = CountBits(info.Preferred & ~flags) + CountBits(info.Unwanted & flags);
+		if (found == false || cost < lowestCost)
+		{
+			memoryTypeIndex = i;
+			lowestCost = cost;
+			found = true;
+		}
+	}
+	return found;
+}
+
+MemoryPool& VulkanAllocator::GetMemoryPool(uint32 memoryTypeIndex)
+{
+	MemoryPool& pool = m_MemoryPools[memoryTypeIndex];
+	if (pool.BlockSize == 0)
+	{
+		pool.MemoryTypeIndex = memoryTypeIndex;
+		pool.CpuVisible = (m_DeviceMemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+		pool.BlockSize = GetPreferredBlockSize(memoryTypeIndex);
+	}
+	return pool;
+}
+
+void VulkanAllocator::Flush(const VulkanAllocation& allocation, VkDeviceSize offset, VkDeviceSize size)
+{
+	VkMappedMemoryRange range;
+	if (GetNonCoherentRange(allocation, offset, size, range))
+	{
+		vkFlushMappedMemoryRanges(m_Device, 1, &range);
+	}
+}
+
+void VulkanAllocator::Invalidate(const VulkanAllocation& allocation, VkDeviceSize offset, VkDeviceSize size)
+{
+	VkMappedMemoryRange range;
+	if (GetNonCoherentRange(allocation, offset, size, range))
+	{
+		vkInvalidateMappedMemoryRanges(m_Device, 1, &range);
+	}
+}
+
+bool VulkanAllocator::GetNonCoherentRange(const VulkanAllocation& allocation, VkDeviceSize offset, VkDeviceSize size, VkMappedMemoryRange& range) const
+{
+	if (allocation.pCpuPointer == nullptr || (m_DeviceMemoryProperties.memoryTypes[allocation.MemoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+	{
+		return false;
+	}
+	if (size == VK_WHOLE_SIZE)
+	{
+		size = allocation.Size - offset;
+	}
+
+	//The range has to be aligned to the atom size, blocks are aligned so rounding out stays inside the memory object
+	VkDeviceSize begin = allocation.Offset + offset;
+	VkDeviceSize end = begin + size;
+	begin = begin / m_NonCoherentAtomSize * m_NonCoherentAtomSize;
+	end = (end + m_NonCoherentAtomSize - 1) / m_NonCoherentAtomSize * m_NonCoherentAtomSize;
+
+	VkDeviceSize memorySize = allocation.Dedicated ? allocation.Size : allocation.pBlock->pAllocator->GetSize();
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.pNext = nullptr;
+	range.memory = allocation.Memory;
+	range.offset = begin;
+	range.size = end >= memorySize ? VK_WHOLE_SIZE : end - begin;
+	return true;
+}
+
 void VulkanAllocator::Free(VulkanAllocation& allocation)
 {
-	//Not implemented
+	if (allocation.pChunk != nullptr)
+	{
+		FreeFromChunk(allocation.pChunk, allocation.Handle);
+		allocation = VulkanAllocation();
+		return;
+	}
+
+	std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+	if (allocation.Dedicated)
+	{
+		--m_DedicatedAllocationCounts[allocation.MemoryTypeIndex];
+		m_DedicatedAllocationBytes[allocation.MemoryTypeIndex] -= allocation.Size;
+		m_pBackend->FreeMemory(allocation.Memory, allocation.pCpuPointer);
+		allocation = VulkanAllocation();
+		return;
+	}
+	if (allocation.pBlock == nullptr)
+	{
+		return;
+	}
+	TraceFree(allocation.Memory, allocation.Offset);
+	FreeFromBlock(allocation.pBlock, allocation.Handle);
+	allocation = VulkanAllocation();
+}
+
+void VulkanAllocator::FreeFromBlock(MemoryBlock* pBlock, uint32 handle)
+{
+	pBlock->pAllocator->Free(handle);
+	if (pBlock->pAllocator->IsEmpty())
+	{
+		pBlock->EmptySinceFrame = m_FrameIndex;
+	}
+}
+
+void VulkanAllocator::BeginFrame(uint64 frameIndex)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+	m_FrameIndex = frameIndex;
+	for (auto& pair : m_MemoryPools)
+	{
+		pair.second.ReleaseEmptyBlocks(*m_pBackend, frameIndex, EMPTY_BLOCK_GRACE_FRAMES);
+	}
+}
+
+VkDeviceSize VulkanAllocator::GetPreferredBlockSize(uint32 memoryTypeIndex) const
+{
+	//Small heaps (eg. the host visible part of VRAM) get an eighth of the heap per block
+	uint32 heapIndex = m_DeviceMemoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+	VkDeviceSize heapSize = m_DeviceMemoryProperties.memoryHeaps[heapIndex].size;
+	if (heapSize <= SMALL_HEAP_MAX_SIZE)
+	{
+		return heapSize / 8;
+	}
+	return LARGE_HEAP_BLOCK_SIZE;
+}
+
+void VulkanAllocator::BeginTrace(const std::string& filePath)
+{
+	std::lock_guard<std::mutex> lock(m_TraceMutex);
+	m_pTraceStream = std::make_unique<std::ofstream>(filePath);
+	m_Tracing = true;
+}
+
+void VulkanAllocator::EndTrace()
+{
+	std::lock_guard<std::mutex> lock(m_TraceMutex);
+	m_Tracing = false;
+	m_pTraceStream.reset();
+}
+
+void VulkanAllocator::TraceAllocate(VkDeviceMemory memory, VkDeviceSize offset, const VkMemoryRequirements& requirements)
+{
+	if (m_Tracing)
+	{
+		std::lock_guard<std::mutex> lock(m_TraceMutex);
+		if (m_pTraceStream != nullptr)
+		{
+			*m_pTraceStream << "a " << (uint64)memory << " " << offset << " " << requirements.size << " " << requirements.alignment << "\n";
+		}
+	}
+}
+
+void VulkanAllocator::TraceFree(VkDeviceMemory memory, VkDeviceSize offset)
+{
+	if (m_Tracing)
+	{
+		std::lock_guard<std::mutex> lock(m_TraceMutex);
+		if (m_pTraceStream != nullptr)
+		{
+			*m_pTraceStream << "f " << (uint64)memory << " " << offset << "\n";
+		}
+	}
+}
+
+void VulkanAllocator::GetStatistics(AllocatorStatistics& statistics) const
+{
+	std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+	statistics = AllocatorStatistics();
+
+	for (uint32 i = 0; i < m_DeviceMemoryProperties.memoryTypeCount; ++i)
+	{
+		MemoryStatistics& typeStatistics = statistics.MemoryTypes[i];
+		typeStatistics.ReservedBytes = m_DedicatedAllocationBytes[i];
+		typeStatistics.UsedBytes = m_DedicatedAllocationBytes[i];
+		typeStatistics.AllocationCount = m_DedicatedAllocationCounts[i];
+		typeStatistics.DedicatedAllocationCount = m_DedicatedAllocationCounts[i];
+	}
+	for (const auto& pair : m_MemoryPools)
+	{
+		MemoryStatistics& typeStatistics = statistics.MemoryTypes[pair.first];
+		for (const auto& pBlock : pair.second.Blocks)
+		{
+			const TLSFAllocator* pAllocator = pBlock->pAllocator.get();
+			typeStatistics.ReservedBytes += pAllocator->GetSize();
+			typeStatistics.UsedBytes += pAllocator->GetUsedSize();
+			typeStatistics.LargestFreeRange = std::max(typeStatistics.LargestFreeRange, pAllocator->GetLargestFreeRange());
+			typeStatistics.AllocationCount += pAllocator->GetAllocationCount();
+			++typeStatistics.BlockCount;
+		}
+	}
+
+	for (uint32 i = 0; i < m_DeviceMemoryProperties.memoryTypeCount; ++i)
+	{
+		uint32 heapIndex = m_DeviceMemoryProperties.memoryTypes[i].heapIndex;
+		statistics.Heaps[heapIndex].Memory.Add(statistics.MemoryTypes[i]);
+		statistics.Total.Add(statistics.MemoryTypes[i]);
+	}
+
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+	if (m_MemoryBudgetSupported)
+	{
+		budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+		VkPhysicalDeviceMemoryProperties2 properties = {};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+		properties.pNext = &budget;
+		vkGetPhysicalDeviceMemoryProperties2(m_PhysicalDevice, &properties);
+		statistics.BudgetFromDriver = true;
+	}
+	for (uint32 i = 0; i < m_DeviceMemoryProperties.memoryHeapCount; ++i)
+	{
+		HeapStatistics& heap = statistics.Heaps[i];
+		heap.Size = m_DeviceMemoryProperties.memoryHeaps[i].size;
+		if (statistics.BudgetFromDriver)
+		{
+			heap.Budget = budget.heapBudget[i];
+			heap.Usage = budget.heapUsage[i];
+		}
+		else
+		{
+			heap.Budget = (VkDeviceSize)(heap.Size * ESTIMATED_HEAP_BUDGET_RATIO);
+			heap.Usage = heap.Memory.ReservedBytes;
+		}
+	}
+}
+
+void VulkanAllocator::DumpStatistics(std::ostream& stream) const
+{
+	std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+	AllocatorStatistics statistics;
+	GetStatistics(statistics);
+
+	stream << "{" << std::endl;
+	stream << "\t\"BudgetFromDriver\": " << (statistics.BudgetFromDriver ? "true" : "false") << "," << std::endl;
+	stream << "\t\"Total\": ";
+	WriteMemoryStatistics(stream, statistics.Total);
+	stream << "," << std::endl;
+
+	stream << "\t\"Heaps\": [" << std::endl;
+	for (uint32 heapIndex = 0; heapIndex < m_DeviceMemoryProperties.memoryHeapCount; ++heapIndex)
+	{
+		const HeapStatistics& heap = statistics.Heaps[heapIndex];
+		stream << "\t\t{" << std::endl;
+		stream << "\t\t\t\"Index\": " << heapIndex << "," << std::endl;
+		stream << "\t\t\t\"DeviceLocal\": " << ((m_DeviceMemoryProperties.memoryHeaps[heapIndex].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? "true" : "false") << "," << std::endl;
+		stream << "\t\t\t\"Size\": " << heap.Size << "," << std::endl;
+		stream << "\t\t\t\"Budget\": " << heap.Budget << "," << std::endl;
+		stream << "\t\t\t\"Usage\": " << heap.Usage << "," << std::endl;
+		stream << "\t\t\t\"Statistics\": ";
+		WriteMemoryStatistics(stream, heap.Memory);
+		stream << "," << std::endl;
+
+		stream << "\t\t\t\"MemoryTypes\": [";
+		bool firstType = true;
+		for (uint32 typeIndex = 0; typeIndex < m_DeviceMemoryProperties.memoryTypeCount; ++typeIndex)
+		{
+			if (m_DeviceMemoryProperties.memoryTypes[typeIndex].heapIndex != heapIndex)
+			{
+				continue;
+			}
+			stream << (firstType ? "" : ",") << std::endl;
+			firstType = false;
+
+			stream << "\t\t\t\t{" << std::endl;
+			stream << "\t\t\t\t\t\"Index\": " << typeIndex << "," << std::endl;
+			stream << "\t\t\t\t\t\"Flags\": ";
+			WriteMemoryFlags(stream, m_DeviceMemoryProperties.memoryTypes[typeIndex].propertyFlags);
+			stream << "," << std::endl;
+			stream << "\t\t\t\t\t\"Statistics\": ";
+			WriteMemoryStatistics(stream, statistics.MemoryTypes[typeIndex]);
+			stream << "," << std::endl;
+
+			stream << "\t\t\t\t\t\"Blocks\": [";
+			auto pool = m_MemoryPools.find(typeIndex);
+			if (pool != m_MemoryPools.end())
+			{
+				for (size_t i = 0; i < pool->second.Blocks.size(); ++i)
+				{
+					const TLSFAllocator* pAllocator = pool->second.Blocks[i]->pAllocator.get();
+					stream << (i == 0 ? "" : ",") << std::endl;
+					stream << "\t\t\t\t\t\t{ \"Size\": " << pAllocator->GetSize();
+					stream << ", \"UsedBytes\": " << pAllocator->GetUsedSize();
+					stream << ", \"AllocationCount\": " << pAllocator->GetAllocationCount();
+					stream << ", \"LargestFreeRange\": " << pAllocator->GetLargestFreeRange() << " }";
+				}
+			}
+			stream << " ]" << std::endl;
+			stream << "\t\t\t\t}";
+		}
+		stream << std::endl << "\t\t\t]" << std::endl;
+		stream << "\t\t}" << (heapIndex + 1 < m_DeviceMemoryProperties.memoryHeapCount ? "," : "") << std::endl;
+	}
+	stream << "\t]" << std::endl;
+	stream << "}" << std::endl;
 }
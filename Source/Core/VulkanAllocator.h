@@ -1,64 +1,221 @@
 #pragma once
+#include "MemoryPool.h"
 class Graphics;
+class RelocatableResource;
 
-struct MemoryPool
+//VK_EXT_memory_budget is newer than the SDK headers
+#ifndef VK_EXT_memory_budget
+#define VK_EXT_memory_budget 1
+#define VK_EXT_MEMORY_BUDGET_EXTENSION_NAME "VK_EXT_memory_budget"
+#define VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT ((VkStructureType)1000237000)
+typedef struct VkPhysicalDeviceMemoryBudgetPropertiesEXT
+{
+	VkStructureType sType;
+	void* pNext;
+	VkDeviceSize heapBudget[VK_MAX_MEMORY_HEAPS];
+	VkDeviceSize heapUsage[VK_MAX_MEMORY_HEAPS];
+} VkPhysicalDeviceMemoryBudgetPropertiesEXT;
+#endif
+
+//Describes how the CPU and GPU access memory, each usage has a list of memory types it falls back to
+enum class MemoryUsage
+{
+	//Only accessed by the GPU. Textures, render targets and static geometry
+	GpuOnly = 0,
+	//Written by the CPU, read by the GPU. Staging buffers
+	CpuToGpu,
+	//Written by the GPU, read by the CPU. Readbacks and queries
+	GpuToCpu,
+	//Written by the CPU every frame, read by the GPU. Uniforms and dynamic geometry
+	CpuToGpuDeviceLocal,
+	MAX
+};
+
+//Range of a block that a worker thread sub-allocates from without taking the allocator lock.
+//Freed ranges are reused while the chunk is the active chunk of its thread.
+//It is returned to the block once the thread has moved on to a new chunk and all its allocations are freed
+struct AllocationChunk
+{
+	MemoryBlock* pBlock = nullptr;
+	uint32 Handle = TLSFAllocator::INVALID_HANDLE;
+	VkDeviceSize Offset = 0;
+	VkDeviceSize Size = 0;
+	//Offsets relative to the chunk. Other threads free into it, so it is guarded by the mutex
+	std::unique_ptr<TLSFAllocator> pAllocator;
+	std::mutex Mutex;
+	//Live allocations plus one while the chunk is the active chunk of a thread
+	std::atomic<uint32> References;
+};
+struct ThreadCache;
+
+struct VulkanAllocation
 {
-	int TypeBits = 0;
 	VkDeviceMemory Memory = VK_NULL_HANDLE;
-	int CurrentOffset = 0;
-	bool CpuVisible = false;
+	VkDeviceSize Offset = 0;
+	VkDeviceSize Size = 0;
 	void* pCpuPointer = nullptr;
-	int Allocations = 0;
+
+	uint32 MemoryTypeIndex = 0;
+	MemoryBlock* pBlock = nullptr;
+	AllocationChunk* pChunk = nullptr;
+	//Handle in the allocator of the chunk, or of the block when there is no chunk
+	uint32 Handle = TLSFAllocator::INVALID_HANDLE;
+	bool Dedicated = false;
+
+	bool IsValid() const { return Memory != VK_NULL_HANDLE; }
 };
 
-struct VulkanAllocation
+struct MemoryStatistics
 {
-	VulkanAllocation(MemoryPool& pool, int size) :
-		Memory(pool.Memory), 
-		Offset(pool.CurrentOffset),
-		Size(size),
-		pCpuPointer((char*)pool.pCpuPointer + pool.CurrentOffset),
-		pParentPool(&pool)
-	{}
-	VkDeviceMemory Memory;
-	int Offset;
-	int Size;
-	void* pCpuPointer;
-
-	MemoryPool* pParentPool;
-
-	void Free()
-	{
-		assert(pParentPool->CurrentOffset == Offset + Size);
-		
-		pParentPool->CurrentOffset -= Size;
-		--pParentPool->Allocations;
-
-		Memory = VK_NULL_HANDLE;
-		Offset = -1;
-		Size = -1;
-		pCpuPointer = nullptr;
-	}
+	//Bytes in VkDeviceMemory objects
+	VkDeviceSize ReservedBytes = 0;
+	//Bytes handed out to resources
+	VkDeviceSize UsedBytes = 0;
+	VkDeviceSize LargestFreeRange = 0;
+	uint32 BlockCount = 0;
+	uint32 AllocationCount = 0;
+	uint32 DedicatedAllocationCount = 0;
+
+	//0 when all free memory is in one range, goes to 1 as it gets scattered over small ranges
+	float GetFragmentation() const;
+	void Add(const MemoryStatistics& other);
+};
+
+struct HeapStatistics
+{
+	MemoryStatistics Memory;
+	VkDeviceSize Size = 0;
+	//How much of the heap the process can use and is using, including memory from other allocators.
+	//Without VK_EXT_memory_budget this is estimated from the heap size and our own usage
+	VkDeviceSize Budget = 0;
+	VkDeviceSize Usage = 0;
 };
 
+struct AllocatorStatistics
+{
+	std::array<MemoryStatistics, VK_MAX_MEMORY_TYPES> MemoryTypes;
+	std::array<HeapStatistics, VK_MAX_MEMORY_HEAPS> Heaps;
+	MemoryStatistics Total;
+	bool BudgetFromDriver = false;
+};
+
+//Allocation is thread safe. Small requests from threads other than the one that created the allocator
+//are served from per-thread chunks, everything else takes a short global lock.
 class VulkanAllocator
 {
 public:
-	VulkanAllocator(VkPhysicalDevice physicalDevice, VkDevice device);
+	VulkanAllocator(VkPhysicalDevice physicalDevice, VkDevice device, bool dedicatedAllocationSupported, bool memoryBudgetSupported);
 	~VulkanAllocator();
 
-	VulkanAllocation Allocate(VkImage image, bool cpuVisible);
-	VulkanAllocation Allocate(VkBuffer buffer, bool cpuVisible);
+	//'dedicated' forces a separate VkDeviceMemory, use it for large or frequently resized resources like render targets.
+	//The driver's preference and large requests also get a dedicated allocation.
+	VulkanAllocation Allocate(VkImage image, MemoryUsage usage, bool dedicated = false);
+	VulkanAllocation Allocate(VkBuffer buffer, MemoryUsage usage, bool dedicated = false);
+	//Allocates memory that isn't tied to a resource, eg. to place several resources in
+	VulkanAllocation AllocateMemory(const VkMemoryRequirements& requirements, MemoryUsage usage, bool dedicated = false);
 	void Free(VulkanAllocation& allocation);
+
+	//Make CPU writes visible to the GPU and GPU writes visible to the CPU. Does nothing on coherent memory
+	void Flush(const VulkanAllocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+	void Invalidate(const VulkanAllocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+	//Allocates memory for a copy of a resource in the same pool but outside of the block it currently lives in.
+	//Never creates blocks, returns an invalid allocation when no other block has room.
+	VulkanAllocation Reallocate(VkImage image, const VulkanAllocation& current);
+	VulkanAllocation Reallocate(VkBuffer buffer, const VulkanAllocation& current);
+	//Registers the resource that owns the allocation so the Defragmenter can move it
+	void SetOwner(const VulkanAllocation& allocation, RelocatableResource* pOwner);
+	//Appends the registered owners of allocations in the block, including the ones in thread chunks, with the size of their allocation.
+	//Lock the mutex while using this
+	void GetOwners(const MemoryBlock* pBlock, std::vector<std::pair<RelocatableResource*, VkDeviceSize>>& owners) const;
+
+	//Lock the mutex while iterating the pools
+	const std::map<uint32, MemoryPool>& GetMemoryPools() const { return m_MemoryPools; }
+	std::recursive_mutex& GetMutex() const { return m_Mutex; }
+
+	//Worker threads should call this before they exit so their chunks can be reclaimed
+	void ReleaseThreadCache();
 	bool MemoryTypeFromProperties(uint32_t typeBits, VkFlags requirements_mask, uint32_t *typeIndex);
 
+	//Releases blocks that have been empty for longer than the grace period
+	void BeginFrame(uint64 frameIndex);
+
+	//Records every allocation and free in a block to a text file that the AllocatorBenchmark tool can replay.
+	//Allocations in thread chunks are recorded, the chunks themselves aren't
+	void BeginTrace(const std::string& filePath);
+	void EndTrace();
+	bool IsTracing() const { return m_Tracing; }
+
+	void GetStatistics(AllocatorStatistics& statistics) const;
+	//Writes the statistics and every block as JSON
+	void DumpStatistics(std::ostream& stream) const;
+
 private:
-	VulkanAllocation Allocate(VkMemoryRequirements& requirements, bool cpuVisible);
+	struct MemoryUsageInfo
+	{
+		VkMemoryPropertyFlags Required;
+		VkMemoryPropertyFlags Preferred;
+		VkMemoryPropertyFlags Unwanted;
+		MemoryUsage Fallback;
+	};
+	static const MemoryUsageInfo MEMORY_USAGES[(int)MemoryUsage::MAX];
+
+	VulkanAllocation Allocate(const VkMemoryRequirements& requirements, MemoryUsage usage, bool dedicated, VkImage image, VkBuffer buffer);
+	VulkanAllocation Reallocate(VkMemoryRequirements& requirements, const VulkanAllocation& current);
+	bool AllocateFromPool(MemoryPool& pool, const VkMemoryRequirements& requirements, VulkanAllocation& allocation);
+	bool AllocateFromThreadCache(uint32 memoryTypeIndex, const VkMemoryRequirements& requirements, VulkanAllocation& allocation);
+	ThreadCache* GetThreadCache();
+	AllocationChunk* CreateChunk(uint32 memoryTypeIndex);
+	bool AllocateFromChunk(AllocationChunk* pChunk, const VkMemoryRequirements& requirements, VkDeviceSize& offset, uint32& handle);
+	void FreeFromChunk(AllocationChunk* pChunk, uint32 handle);
+	void ReleaseChunk(AllocationChunk* pChunk);
+	void FreeFromBlock(MemoryBlock* pBlock, uint32 handle);
+	bool AllocateFromBlock(MemoryPool& pool, MemoryBlock* pBlock, const VkMemoryRequirements& requirements, VulkanAllocation& allocation);
+	void InitializeAllocation(MemoryPool& pool, MemoryBlock* pBlock, const VkMemoryRequirements& requirements, VulkanAllocation& allocation);
+	bool AllocateDedicated(const VkMemoryRequirements& requirements, uint32 memoryTypeIndex, VkImage image, VkBuffer buffer, VulkanAllocation& allocation);
+	bool FindMemoryType(uint32 memoryTypeBits, MemoryUsage usage, uint32& memoryTypeIndex) const;
+	MemoryPool& GetMemoryPool(uint32 memoryTypeIndex);
+	bool GetNonCoherentRange(const VulkanAllocation& allocation, VkDeviceSize offset, VkDeviceSize size, VkMappedMemoryRange& range) const;
+	VkDeviceSize GetPreferredBlockSize(uint32 memoryTypeIndex) const;
+	void TraceAllocate(VkDeviceMemory memory, VkDeviceSize offset, const VkMemoryRequirements& requirements);
+	void TraceFree(VkDeviceMemory memory, VkDeviceSize offset);
+
+	static const VkDeviceSize LARGE_HEAP_BLOCK_SIZE = 256ull * 1024 * 1024;
+	static const VkDeviceSize SMALL_HEAP_MAX_SIZE = 1024ull * 1024 * 1024;
+	static const uint64 EMPTY_BLOCK_GRACE_FRAMES = 300;
+	//Worker thread requests up to this size are served from thread chunks
+	static const VkDeviceSize SMALL_ALLOCATION_SIZE = 64 * 1024;
+	static const VkDeviceSize CHUNK_SIZE = 1024 * 1024;
+	//Share of a heap assumed to be available when the driver doesn't report a budget
+	static constexpr float ESTIMATED_HEAP_BUDGET_RATIO = 0.8f;
 
-	static const int POOL_SIZE = 4096 * 40960;
+	mutable std::recursive_mutex m_Mutex;
+	uint32 m_Id = 0;
+	std::thread::id m_OwnerThread;
+	std::vector<std::unique_ptr<ThreadCache>> m_ThreadCaches;
+	std::vector<AllocationChunk*> m_Chunks;
+	//Chunks mix buffers and images so they start on a granularity page
+	VkDeviceSize m_ChunkAlignment = 256;
 
+	VkPhysicalDevice m_PhysicalDevice;
 	VkDevice m_Device;
+	std::unique_ptr<MemoryBackend> m_pBackend;
 	std::map<uint32, MemoryPool> m_MemoryPools;
 	VkPhysicalDeviceMemoryProperties m_DeviceMemoryProperties;
-};
+	VkDeviceSize m_BufferImageGranularity = 1;
+	VkDeviceSize m_NonCoherentAtomSize = 1;
+
+	bool m_DedicatedAllocationSupported = false;
+	PFN_vkGetBufferMemoryRequirements2KHR m_pGetBufferMemoryRequirements2 = nullptr;
+	PFN_vkGetImageMemoryRequirements2KHR m_pGetImageMemoryRequirements2 = nullptr;
+	bool m_MemoryBudgetSupported = false;
+	uint64 m_FrameIndex = 0;
 
+	//Chunks write to the trace without the allocator lock
+	std::mutex m_TraceMutex;
+	std::atomic<bool> m_Tracing{ false };
+	std::unique_ptr<std::ofstream> m_pTraceStream;
+
+	std::array<uint32, VK_MAX_MEMORY_TYPES> m_DedicatedAllocationCounts = {};
+	std::array<VkDeviceSize, VK_MAX_MEMORY_TYPES> m_DedicatedAllocationBytes = {};
+};
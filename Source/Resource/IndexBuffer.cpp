@@ -2,6 +2,10 @@
 #include "IndexBuffer.h"
 #include "Core/Graphics.h"
 #include "Core/VulkanAllocator.h"
+#include "Core/CommandBuffer.h"
+#include "Core/UploadManager.h"
+#include "Core/DeferredReleaseQueue.h"
+#include "Core/ResourceStateTracker.h"
 
 IndexBuffer::IndexBuffer(Graphics* pGraphics) :
 	m_pGraphics(pGraphics)
@@ -11,7 +15,21 @@ IndexBuffer::IndexBuffer(Graphics* pGraphics) :
 
 IndexBuffer::~IndexBuffer()
 {
-	vkDestroyBuffer(m_pGraphics->GetDevice(), m_Buffer, nullptr);
+	if (m_pGraphics->GetDefragmenter())
+	{
+		m_pGraphics->GetDefragmenter()->CancelRelocation(this);
+	}
+	DeferredReleaseQueue* pReleaseQueue = m_pGraphics->GetReleaseQueue();
+	ResourceStateTracker* pTracker = m_pGraphics->GetResourceStateTracker();
+	if (m_RelocationBuffer != VK_NULL_HANDLE)
+	{
+		pTracker->UnregisterBuffer(m_RelocationBuffer);
+		pReleaseQueue->ReleaseBuffer(m_RelocationBuffer);
+		pReleaseQueue->ReleaseAllocation(m_RelocationAllocation);
+	}
+	pTracker->UnregisterBuffer(m_Buffer);
+	pReleaseQueue->ReleaseBuffer(m_Buffer);
+	pReleaseQueue->ReleaseAllocation(m_Allocation);
 }
 
 void IndexBuffer::SetSize(const int count, bool smallIndices, const bool dynamic /*= false*/)
@@ -20,6 +38,88 @@ void IndexBuffer::SetSize(const int count, bool smallIndices, const bool dynamic
 	m_IndexCount = count;
 	m_Size = count * m_IndexSize;
 
+	m_Buffer = CreateBuffer();
+
+	m_Allocation = m_pGraphics->GetAllocator()->Allocate(m_Buffer, dynamic ? MemoryUsage::CpuToGpuDeviceLocal : MemoryUsage::GpuOnly);
+
+	vkBindBufferMemory(m_pGraphics->GetDevice(), m_Buffer, m_Allocation.Memory, m_Allocation.Offset);
+	m_pGraphics->GetAllocator()->SetOwner(m_Allocation, this);
+}
+
+void IndexBuffer::SetData(void* pData)
+{
+	//A copy that is in flight misses the upload, it is discarded and the buffer stays where it is
+	VkBuffer buffer;
+	{
+		std::lock_guard<std::mutex> lock(m_RelocationMutex);
+		++m_PendingUploads;
+		buffer = m_Buffer;
+		m_RelocationDiscarded |= m_RelocationBuffer != VK_NULL_HANDLE;
+	}
+	uint64 token = m_pGraphics->GetUploadManager()->UploadBuffer(buffer, ResourceUsage::IndexBuffer, pData, m_Size);
+
+	std::lock_guard<std::mutex> lock(m_RelocationMutex);
+	--m_PendingUploads;
+	m_UploadToken = std::max(m_UploadToken, token);
+}
+
+RelocationResult IndexBuffer::BeginRelocation(CommandBuffer* pCommandBuffer)
+{
+	//The copy would miss uploads that haven't executed yet
+	std::lock_guard<std::mutex> lock(m_RelocationMutex);
+	if (m_PendingUploads > 0 || m_pGraphics->GetUploadManager()->IsComplete(m_UploadToken) == false)
+	{
+		return RelocationResult::Busy;
+	}
+
+	VkBuffer buffer = CreateBuffer();
+	VulkanAllocation allocation = m_pGraphics->GetAllocator()->Reallocate(buffer, m_Allocation);
+	if (allocation.IsValid() == false)
+	{
+		vkDestroyBuffer(m_pGraphics->GetDevice(), buffer, nullptr);
+		return RelocationResult::NoRoom;
+	}
+	vkBindBufferMemory(m_pGraphics->GetDevice(), buffer, allocation.Memory, allocation.Offset);
+
+	ResourceStateTracker* pTracker = m_pGraphics->GetResourceStateTracker();
+	pTracker->UseBuffer(pCommandBuffer, m_Buffer, ResourceUsage::TransferSource);
+	pTracker->UseBuffer(pCommandBuffer, buffer, ResourceUsage::TransferDestination);
+	pTracker->FlushBarriers(pCommandBuffer);
+	pCommandBuffer->CopyBuffer(m_Buffer, buffer, m_Size);
+	pTracker->UseBuffer(pCommandBuffer, buffer, ResourceUsage::IndexBuffer);
+	pTracker->FlushBarriers(pCommandBuffer);
+
+	m_RelocationBuffer = buffer;
+	m_RelocationAllocation = allocation;
+	return RelocationResult::Started;
+}
+
+bool IndexBuffer::EndRelocation()
+{
+	std::lock_guard<std::mutex> lock(m_RelocationMutex);
+	DeferredReleaseQueue* pReleaseQueue = m_pGraphics->GetReleaseQueue();
+	ResourceStateTracker* pTracker = m_pGraphics->GetResourceStateTracker();
+	bool discarded = m_RelocationDiscarded;
+	m_RelocationDiscarded = false;
+	if (discarded == false)
+	{
+		m_pGraphics->GetAllocator()->SetOwner(m_RelocationAllocation, this);
+		//Frames in flight still draw with the old buffer
+		std::swap(m_Buffer, m_RelocationBuffer);
+		std::swap(m_Allocation, m_RelocationAllocation);
+	}
+
+	//The old buffer, or the copy that missed an upload
+	pTracker->UnregisterBuffer(m_RelocationBuffer);
+	pReleaseQueue->ReleaseBuffer(m_RelocationBuffer);
+	pReleaseQueue->ReleaseAllocation(m_RelocationAllocation);
+	m_RelocationBuffer = VK_NULL_HANDLE;
+	m_RelocationAllocation = VulkanAllocation();
+	return discarded == false;
+}
+
+VkBuffer IndexBuffer::CreateBuffer() const
+{
 	VkBufferCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	createInfo.flags = 0;
@@ -28,15 +128,8 @@ void IndexBuffer::SetSize(const int count, bool smallIndices, const bool dynamic
 	createInfo.queueFamilyIndexCount = 0;
 	createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	createInfo.size = m_Size;
-	createInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-	vkCreateBuffer(m_pGraphics->GetDevice(), &createInfo, nullptr, &m_Buffer);
-
-	VulkanAllocation allocation = m_pGraphics->GetAllocator()->Allocate(m_Buffer, dynamic);
-
-	vkBindBufferMemory(m_pGraphics->GetDevice(), m_Buffer, allocation.Memory, allocation.Offset);
-}
-
-void IndexBuffer::SetData(void* pData)
-{
-	m_pGraphics->CopyBufferWithStaging(m_Buffer, pData);
+	createInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	VkBuffer buffer;
+	vkCreateBuffer(m_pGraphics->GetDevice(), &createInfo, nullptr, &buffer);
+	return buffer;
 }
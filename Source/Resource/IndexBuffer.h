@@ -1,7 +1,9 @@
 #pragma once
+#include "Core/VulkanAllocator.h"
+#include "Core/Defragmenter.h"
 class Graphics;
 
-class IndexBuffer
+class IndexBuffer : public RelocatableResource
 {
 public:
 	IndexBuffer(Graphics* pGraphics);
@@ -11,12 +13,19 @@ public:
 	void SetData(void* pData);
 
 	const VkBuffer& GetBuffer() const { return m_Buffer; }
+
+	virtual RelocationResult BeginRelocation(CommandBuffer* pCommandBuffer) override;
+	virtual bool EndRelocation() override;
 	int GetCount() const { return m_IndexCount; }
 
 private:
+	VkBuffer CreateBuffer() const;
+
 	Graphics * m_pGraphics;
 	VkBuffer m_Buffer;
-	VkDeviceMemory m_Memory;
+	VulkanAllocation m_Allocation;
+	VkBuffer m_RelocationBuffer = VK_NULL_HANDLE;
+	VulkanAllocation m_RelocationAllocation;
 	int m_IndexCount = 0;
 	int m_IndexSize = 0;
 	int m_Size = 0;
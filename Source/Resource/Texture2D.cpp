@@ -5,6 +5,11 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "External/stb_image.h"
 #include "Core/VulkanAllocator.h"
+#include "Core/CommandBuffer.h"
+#include "Core/TransientAllocator.h"
+#include "Core/UploadManager.h"
+#include "Core/DeferredReleaseQueue.h"
+#include "Core/ResourceStateTracker.h"
 
 
 Texture2D::Texture2D(Graphics* pGraphics) :
@@ -15,15 +20,32 @@ Texture2D::Texture2D(Graphics* pGraphics) :
 
 Texture2D::~Texture2D()
 {
+	if (m_pGraphics->GetDefragmenter())
+	{
+		m_pGraphics->GetDefragmenter()->CancelRelocation(this);
+	}
+	DeferredReleaseQueue* pReleaseQueue = m_pGraphics->GetReleaseQueue();
+	ResourceStateTracker* pTracker = m_pGraphics->GetResourceStateTracker();
+	if (m_RelocationImage != VK_NULL_HANDLE)
+	{
+		pTracker->UnregisterImage(m_RelocationImage);
+		pReleaseQueue->ReleaseImage(m_RelocationImage);
+		pReleaseQueue->ReleaseAllocation(m_RelocationAllocation);
+	}
 	if (m_ImageOwned)
 	{
-		vkDestroyImage(m_pGraphics->GetDevice(), (VkImage)m_Image, nullptr);
+		pTracker->UnregisterImage((VkImage)m_Image);
+		pReleaseQueue->ReleaseImage((VkImage)m_Image);
+		if (m_pTransientAllocator == nullptr)
+		{
+			pReleaseQueue->ReleaseAllocation(m_Allocation);
+		}
 	}
-	vkDestroyImageView(m_pGraphics->GetDevice(), (VkImageView)m_View, nullptr);
+	pReleaseQueue->ReleaseImageView((VkImageView)m_View);
 
 	if (m_Sampler != VK_NULL_HANDLE)
 	{
-		vkDestroySampler(m_pGraphics->GetDevice(), (VkSampler)m_Sampler, nullptr);
+		pReleaseQueue->ReleaseSampler((VkSampler)m_Sampler);
 	}
 }
 
@@ -35,8 +57,8 @@ bool Texture2D::Load(const std::string& filePath)
 	stream.read(buffer.data(), buffer.size());
 
 	unsigned char* pPixels = stbi_load_from_memory((unsigned char*)buffer.data(), (uint32)buffer.size(), &m_Width, &m_Height, &m_Components, 4);
-	SetSize(m_Width, m_Height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 1, 0);
-	SetData(1, 0, 0, m_Width, m_Height, pPixels);
+	SetSize(m_Width, m_Height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 1, 0);
+	SetData(0, 0, 0, m_Width, m_Height, pPixels);
 	stbi_image_free(pPixels);
 
 	UpdateParameters();
@@ -46,33 +68,40 @@ bool Texture2D::Load(const std::string& filePath)
 
 void Texture2D::SetSize(const int width, const int height, const unsigned int format, unsigned int usage, const int multiSample, int64 pTexture)
 {
+	m_Width = width;
+	m_Height = height;
+	m_Format = (VkFormat)format;
+	m_Usage = usage;
+	m_MultiSample = multiSample;
+	if (usage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT || usage & VK_IMAGE_USAGE_SAMPLED_BIT)
+	{
+		m_AspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	}
+	else if (usage == VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)
+	{
+		m_AspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	}
+
 	if (pTexture == VK_NULL_HANDLE)
 	{
 		m_ImageOwned = true;
-		VkImageCreateInfo imageCreateInfo = {};
-		imageCreateInfo.arrayLayers = 1;
-		imageCreateInfo.extent.depth = 1;
-		imageCreateInfo.extent.width = width;
-		imageCreateInfo.extent.height = height;
-		imageCreateInfo.flags = 0;
-		imageCreateInfo.format = (VkFormat)format;
-		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		imageCreateInfo.mipLevels = 1;
-		imageCreateInfo.pNext = nullptr;
-		imageCreateInfo.pQueueFamilyIndices = nullptr;
-		imageCreateInfo.queueFamilyIndexCount = 0;
-		imageCreateInfo.samples = (VkSampleCountFlagBits)multiSample;
-		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-		imageCreateInfo.usage = usage;
-		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-		vkCreateImage(m_pGraphics->GetDevice(), &imageCreateInfo, nullptr, (VkImage*)&m_Image);
-		m_ImageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-
-		VulkanAllocation allocation = m_pGraphics->GetAllocator()->Allocate((VkImage)m_Image, false);
-		m_MemorySize = allocation.Size;
-		vkBindImageMemory(m_pGraphics->GetDevice(), (VkImage)m_Image, allocation.Memory, allocation.Offset);
+		m_Image = (GpuObject)CreateImage();
+		m_pGraphics->GetResourceStateTracker()->RegisterImage((VkImage)m_Image, m_AspectMask, 1, 1);
+
+		if (m_pTransientAllocator != nullptr)
+		{
+			m_pTransientAllocator->DeclareImage((VkImage)m_Image, m_FirstPass, m_LastPass, [this]() { m_View = (GpuObject)CreateView((VkImage)m_Image); });
+			return;
+		}
+
+		//Render targets get recreated on resize, keep them out of the shared blocks
+		bool isRenderTarget = (usage & (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)) != 0;
+		m_Allocation = m_pGraphics->GetAllocator()->Allocate((VkImage)m_Image, MemoryUsage::GpuOnly, isRenderTarget);
+		vkBindImageMemory(m_pGraphics->GetDevice(), (VkImage)m_Image, m_Allocation.Memory, m_Allocation.Offset);
+		if (usage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)
+		{
+			m_pGraphics->GetAllocator()->SetOwner(m_Allocation, this);
+		}
 	}
 	else
 	{
@@ -80,77 +109,42 @@ void Texture2D::SetSize(const int width, const int height, const unsigned int fo
 		m_Image = pTexture;
 	}
 
-	//Create Image view
-	VkImageViewCreateInfo viewCreateInfo;
-	viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	viewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_R;
-	viewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_G;
-	viewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_B;
-	viewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_A;
-	viewCreateInfo.flags = 0;
-	viewCreateInfo.format = (VkFormat)format;
-	viewCreateInfo.image = (VkImage)m_Image;
-	viewCreateInfo.pNext = nullptr;
-	if (usage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT || usage & VK_IMAGE_USAGE_SAMPLED_BIT)
-	{
-		viewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	}
-	else if (usage == VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)
-	{
-		viewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-	}
-	viewCreateInfo.subresourceRange.baseArrayLayer = 0;
-	viewCreateInfo.subresourceRange.baseMipLevel = 0;
-	viewCreateInfo.subresourceRange.levelCount = 1;
-	viewCreateInfo.subresourceRange.layerCount = 1;
-	viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	vkCreateImageView(m_pGraphics->GetDevice(), &viewCreateInfo, nullptr, (VkImageView*)&m_View);
+	m_View = (GpuObject)CreateView((VkImage)m_Image);
 }
 
 bool Texture2D::SetData(const unsigned int mipLevel, int x, int y, int width, int height, const void* pData)
 {
-	VkBuffer stagingBuffer;
-	VkBufferCreateInfo createInfo = {};
-	createInfo.flags = 0;
-	createInfo.pNext = nullptr;
-	createInfo.pQueueFamilyIndices = nullptr;
-	createInfo.queueFamilyIndexCount = 0;
-	createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	createInfo.size = m_MemorySize;
-	createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	createInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-	vkCreateBuffer(m_pGraphics->GetDevice(), &createInfo, nullptr, &stagingBuffer);
-
-	VulkanAllocation allocation = m_pGraphics->GetAllocator()->Allocate(stagingBuffer, true);
-
-	vkBindBufferMemory(m_pGraphics->GetDevice(), stagingBuffer, allocation.Memory, allocation.Offset);
-	memcpy(allocation.pCpuPointer, pData, m_MemorySize);
-
-	std::unique_ptr<CommandBuffer> copyCmd = m_pGraphics->GetTempCommandBuffer(true);
-	
-	VkImageSubresourceRange subresourceRange = {};
-	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	subresourceRange.baseMipLevel = 0;
-	subresourceRange.levelCount = 1;
-	subresourceRange.layerCount = 1;
-
-	SetLayout(copyCmd->GetBuffer(), VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
-	copyCmd->CopyBufferToImage(stagingBuffer, this);
-	SetLayout(copyCmd->GetBuffer(), VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
-
-	m_pGraphics->FlushCommandBuffer(copyCmd);
-
-	m_pGraphics->GetAllocator()->Free(allocation);
-	vkDestroyBuffer(m_pGraphics->GetDevice(), stagingBuffer, nullptr);
+	//Only 4 byte formats are loaded for now
+	VkDeviceSize size = (VkDeviceSize)width * height * 4;
 
+	//A copy that is in flight misses the upload, it is discarded and the image stays where it is
+	VkImage image;
+	{
+		std::lock_guard<std::mutex> lock(m_RelocationMutex);
+		++m_PendingUploads;
+		image = (VkImage)m_Image;
+		m_RelocationDiscarded |= m_RelocationImage != VK_NULL_HANDLE;
+	}
+	uint64 token = m_pGraphics->GetUploadManager()->UploadImage(image, ResourceUsage::ShaderRead, m_AspectMask, mipLevel, x, y, width, height, pData, size);
+
+	std::lock_guard<std::mutex> lock(m_RelocationMutex);
+	--m_PendingUploads;
+	m_UploadToken = std::max(m_UploadToken, token);
 	return true;
 }
 
+void Texture2D::SetTransient(TransientAllocator* pAllocator, uint32 firstPass, uint32 lastPass)
+{
+	m_pTransientAllocator = pAllocator;
+	m_FirstPass = firstPass;
+	m_LastPass = lastPass;
+}
+
 void Texture2D::UpdateParameters()
 {
 	if (m_Sampler != VK_NULL_HANDLE)
 	{
-		vkDestroySampler(m_pGraphics->GetDevice(), (VkSampler)m_Sampler, nullptr);
+		m_pGraphics->GetReleaseQueue()->ReleaseSampler((VkSampler)m_Sampler);
 	}
 
 	VkSamplerCreateInfo samplerCreateInfo = {};
@@ -175,72 +169,117 @@ void Texture2D::UpdateParameters()
 	vkCreateSampler(m_pGraphics->GetDevice(), &samplerCreateInfo, nullptr, (VkSampler*)&m_Sampler);
 }
 
-void Texture2D::SetLayout(VkCommandBuffer cmdBuffer, VkImageAspectFlags aspectMask, VkImageLayout newImageLayout, VkImageSubresourceRange subresourceRange)
+RelocationResult Texture2D::BeginRelocation(CommandBuffer* pCommandBuffer)
 {
-	// Create an image barrier object
-	VkImageMemoryBarrier imageMemoryBarrier = {};
-	imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	imageMemoryBarrier.pNext = nullptr;
-	imageMemoryBarrier.oldLayout = (VkImageLayout)m_ImageLayout;
-	imageMemoryBarrier.newLayout = newImageLayout;
-	imageMemoryBarrier.image = (VkImage)m_Image;
-	imageMemoryBarrier.subresourceRange = subresourceRange;
-
-	// Only sets masks for layouts used in this example
-	// For a more complete version that can be used with other layouts see vks::tools::setImageLayout
-
-	// Source layouts (old)
-	switch ((VkImageLayout)m_ImageLayout)
+	//The copy would miss uploads that haven't executed yet
+	std::lock_guard<std::mutex> lock(m_RelocationMutex);
+	if (m_PendingUploads > 0 || m_pGraphics->GetUploadManager()->IsComplete(m_UploadToken) == false)
 	{
-	case VK_IMAGE_LAYOUT_UNDEFINED:
-		// Only valid as initial layout, memory contents are not preserved
-		// Can be accessed directly, no source dependency required
-		imageMemoryBarrier.srcAccessMask = 0;
-		break;
-	case VK_IMAGE_LAYOUT_PREINITIALIZED:
-		// Only valid as initial layout for linear images, preserves memory contents
-		// Make sure host writes to the image have been finished
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-		break;
-	case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
-		// Old layout is transfer destination
-		// Make sure any writes to the image have been finished
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		break;
+		return RelocationResult::Busy;
 	}
 
-	// Target layouts (new)
-	switch (newImageLayout)
+	VkImage image = CreateImage();
+	VulkanAllocation allocation = m_pGraphics->GetAllocator()->Reallocate(image, m_Allocation);
+	if (allocation.IsValid() == false)
 	{
-	case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
-		// Transfer source (copy, blit)
-		// Make sure any reads from the image have been finished
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		break;
-	case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
-		// Transfer destination (copy, blit)
-		// Make sure any writes to the image have been finished
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		break;
-	case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
-		// Shader read (sampler, input attachment)
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		break;
+		vkDestroyImage(m_pGraphics->GetDevice(), image, nullptr);
+		return RelocationResult::NoRoom;
 	}
+	vkBindImageMemory(m_pGraphics->GetDevice(), image, allocation.Memory, allocation.Offset);
+
+	//Both transitions go out in one barrier before and one after the copy
+	ResourceStateTracker* pTracker = m_pGraphics->GetResourceStateTracker();
+	pTracker->RegisterImage(image, m_AspectMask, 1, 1);
+	pTracker->UseImage(pCommandBuffer, (VkImage)m_Image, ResourceUsage::TransferSource);
+	pTracker->UseImage(pCommandBuffer, image, ResourceUsage::TransferDestination);
+	pTracker->FlushBarriers(pCommandBuffer);
+	pCommandBuffer->CopyImage((VkImage)m_Image, image, m_AspectMask, m_Width, m_Height);
+	pTracker->UseImage(pCommandBuffer, (VkImage)m_Image, ResourceUsage::ShaderRead);
+	pTracker->UseImage(pCommandBuffer, image, ResourceUsage::ShaderRead);
+	pTracker->FlushBarriers(pCommandBuffer);
 
-	// Put barrier on top of pipeline
-	VkPipelineStageFlags srcStageFlags = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
-	VkPipelineStageFlags destStageFlags = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
-
-	// Put barrier inside setup command buffer
-	vkCmdPipelineBarrier(
-		cmdBuffer,
-		srcStageFlags,
-		destStageFlags,
-		0,
-		0, nullptr,
-		0, nullptr,
-		1, &imageMemoryBarrier);
-
-	m_ImageLayout = newImageLayout;
+	m_RelocationImage = image;
+	m_RelocationAllocation = allocation;
+	return RelocationResult::Started;
+}
+
+bool Texture2D::EndRelocation()
+{
+	std::lock_guard<std::mutex> lock(m_RelocationMutex);
+	DeferredReleaseQueue* pReleaseQueue = m_pGraphics->GetReleaseQueue();
+	ResourceStateTracker* pTracker = m_pGraphics->GetResourceStateTracker();
+	if (m_RelocationDiscarded)
+	{
+		//The copy missed an upload, the image stays where it is
+		m_RelocationDiscarded = false;
+		pTracker->UnregisterImage(m_RelocationImage);
+		pReleaseQueue->ReleaseImage(m_RelocationImage);
+		pReleaseQueue->ReleaseAllocation(m_RelocationAllocation);
+		m_RelocationImage = VK_NULL_HANDLE;
+		m_RelocationAllocation = VulkanAllocation();
+		return false;
+	}
+
+	m_pGraphics->GetAllocator()->SetOwner(m_RelocationAllocation, this);
+
+	//Frames in flight still sample from the old image
+	pTracker->UnregisterImage((VkImage)m_Image);
+	pReleaseQueue->ReleaseImageView((VkImageView)m_View);
+	pReleaseQueue->ReleaseImage((VkImage)m_Image);
+	pReleaseQueue->ReleaseAllocation(m_Allocation);
+
+	m_Image = (GpuObject)m_RelocationImage;
+	m_Allocation = m_RelocationAllocation;
+	m_View = (GpuObject)CreateView(m_RelocationImage);
+	m_RelocationImage = VK_NULL_HANDLE;
+	m_RelocationAllocation = VulkanAllocation();
+	return true;
+}
+
+VkImage Texture2D::CreateImage() const
+{
+	VkImageCreateInfo imageCreateInfo = {};
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.extent.depth = 1;
+	imageCreateInfo.extent.width = m_Width;
+	imageCreateInfo.extent.height = m_Height;
+	imageCreateInfo.flags = 0;
+	imageCreateInfo.format = m_Format;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageCreateInfo.mipLevels = 1;
+	imageCreateInfo.pNext = nullptr;
+	imageCreateInfo.pQueueFamilyIndices = nullptr;
+	imageCreateInfo.queueFamilyIndexCount = 0;
+	imageCreateInfo.samples = (VkSampleCountFlagBits)m_MultiSample;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.usage = m_Usage;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	VkImage image;
+	vkCreateImage(m_pGraphics->GetDevice(), &imageCreateInfo, nullptr, &image);
+	return image;
+}
+
+VkImageView Texture2D::CreateView(VkImage image) const
+{
+	VkImageViewCreateInfo viewCreateInfo;
+	viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_R;
+	viewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_G;
+	viewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_B;
+	viewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_A;
+	viewCreateInfo.flags = 0;
+	viewCreateInfo.format = m_Format;
+	viewCreateInfo.image = image;
+	viewCreateInfo.pNext = nullptr;
+	viewCreateInfo.subresourceRange.aspectMask = m_AspectMask;
+	viewCreateInfo.subresourceRange.baseArrayLayer = 0;
+	viewCreateInfo.subresourceRange.baseMipLevel = 0;
+	viewCreateInfo.subresourceRange.levelCount = 1;
+	viewCreateInfo.subresourceRange.layerCount = 1;
+	viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	VkImageView view;
+	vkCreateImageView(m_pGraphics->GetDevice(), &viewCreateInfo, nullptr, &view);
+	return view;
 }
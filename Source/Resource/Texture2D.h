@@ -1,7 +1,10 @@
 #pragma once
+#include "Core/VulkanAllocator.h"
+#include "Core/Defragmenter.h"
 class Graphics;
+class TransientAllocator;
 
-class Texture2D
+class Texture2D : public RelocatableResource
 {
 public:
 	Texture2D(Graphics* pGraphics);
@@ -11,24 +14,40 @@ public:
 	void SetSize(const int width, const int height, const unsigned int format, unsigned int usage, const int multiSample, int64 pTexture);
 	bool SetData(const unsigned int mipLevel, int x, int y, int width, int height, const void* pData);
 	void UpdateParameters();
-
-	void SetLayout(VkCommandBuffer cmdBuffer, VkImageAspectFlags aspectMask, VkImageLayout newImageLayout, VkImageSubresourceRange subresourceRange);
+	//Places the image in memory shared with other transient resources, call before SetSize.
+	//The view is valid once the transient allocator has been built
+	void SetTransient(TransientAllocator* pAllocator, uint32 firstPass, uint32 lastPass);
 
 	GpuObject GetImage() { return m_Image; }
 	GpuObject GetView() { return m_View; }
 	GpuObject GetSampler() { return m_Sampler; }
 
 	unsigned int GetWidth() const { return (unsigned int)m_Width; }
-	unsigned int GetHeight() const { return (unsigned int)m_Width; }
+	unsigned int GetHeight() const { return (unsigned int)m_Height; }
+
+	virtual RelocationResult BeginRelocation(CommandBuffer* pCommandBuffer) override;
+	virtual bool EndRelocation() override;
 
 private:
+	VkImage CreateImage() const;
+	VkImageView CreateView(VkImage image) const;
+
 	Graphics * m_pGraphics;
 	GpuObject m_Image;
 	GpuObject m_View;
 	GpuObject m_Sampler = VK_NULL_HANDLE;
-	uint32 m_ImageLayout = 0;
 	bool m_ImageOwned = true;
-	int m_MemorySize = 0;
+	VulkanAllocation m_Allocation;
+	TransientAllocator* m_pTransientAllocator = nullptr;
+	uint32 m_FirstPass = 0;
+	uint32 m_LastPass = 0;
+	VkImage m_RelocationImage = VK_NULL_HANDLE;
+	VulkanAllocation m_RelocationAllocation;
+
+	VkFormat m_Format = VK_FORMAT_UNDEFINED;
+	VkImageUsageFlags m_Usage = 0;
+	VkImageAspectFlags m_AspectMask = 0;
+	int m_MultiSample = 1;
 
 	int m_Width = 0;
 	int m_Height = 0;
@@ -2,6 +2,7 @@
 #include "UniformBuffer.h"
 #include "Core/Graphics.h"
 #include "Core/VulkanAllocator.h"
+#include "Core/DeferredReleaseQueue.h"
 
 UniformBuffer::UniformBuffer(Graphics* pGraphics) :
 	m_pGraphics(pGraphics)
@@ -11,7 +12,9 @@ UniformBuffer::UniformBuffer(Graphics* pGraphics) :
 
 UniformBuffer::~UniformBuffer()
 {
-	vkDestroyBuffer(m_pGraphics->GetDevice(), m_Buffer, nullptr);
+	DeferredReleaseQueue* pReleaseQueue = m_pGraphics->GetReleaseQueue();
+	pReleaseQueue->ReleaseBuffer(m_Buffer);
+	pReleaseQueue->ReleaseAllocation(m_Allocation);
 }
 
 void* UniformBuffer::Map()
@@ -48,12 +51,12 @@ bool UniformBuffer::SetSize(const int size, const int maxRenames)
 		return false;
 	}
 
-	VulkanAllocation allocation = m_pGraphics->GetAllocator()->Allocate(m_Buffer, true);
-	if(vkBindBufferMemory(m_pGraphics->GetDevice(), m_Buffer, allocation.Memory, allocation.Offset) != VK_SUCCESS)
+	m_Allocation = m_pGraphics->GetAllocator()->Allocate(m_Buffer, MemoryUsage::CpuToGpuDeviceLocal);
+	if(vkBindBufferMemory(m_pGraphics->GetDevice(), m_Buffer, m_Allocation.Memory, m_Allocation.Offset) != VK_SUCCESS)
 	{
 		return false;
 	}
-	m_pDataBegin = allocation.pCpuPointer;
+	m_pDataBegin = m_Allocation.pCpuPointer;
 	m_pCurrentTarget = m_pDataBegin;
 
 	return true;
@@ -1,4 +1,5 @@
 #pragma once
+#include "Core/VulkanAllocator.h"
 class Graphics;
 
 class UniformBuffer
@@ -22,6 +23,7 @@ public:
 private:
 	Graphics * m_pGraphics;
 	VkBuffer m_Buffer;
+	VulkanAllocation m_Allocation;
 
 	void* m_pCurrentTarget = nullptr;
 	void* m_pDataBegin = nullptr;
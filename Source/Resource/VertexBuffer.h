@@ -1,7 +1,9 @@
 #pragma once
+#include "Core/VulkanAllocator.h"
+#include "Core/Defragmenter.h"
 class Graphics;
 
-class VertexBuffer
+class VertexBuffer : public RelocatableResource
 {
 public:
 	VertexBuffer(Graphics* pGraphics);
@@ -13,9 +15,17 @@ public:
 
 	const VkBuffer& GetBuffer() const { return m_Buffer; }
 
+	virtual RelocationResult BeginRelocation(CommandBuffer* pCommandBuffer) override;
+	virtual bool EndRelocation() override;
+
 private:
+	VkBuffer CreateBuffer() const;
+
 	Graphics * m_pGraphics;
 	VkBuffer m_Buffer;
+	VulkanAllocation m_Allocation;
+	VkBuffer m_RelocationBuffer = VK_NULL_HANDLE;
+	VulkanAllocation m_RelocationAllocation;
 
 	int m_Size = 0;
 	int m_BufferSize = 0;
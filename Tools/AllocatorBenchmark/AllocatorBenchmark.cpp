@@ -0,0 +1,460 @@
+#include "stdafx.h"
+#include "NullMemoryBackend.h"
+#include <random>
+#include <cmath>
+#include <sstream>
+
+//Replays allocation traces against the MemoryPool policy of VulkanAllocator without a GPU.
+//Traces are either generated or recorded in the engine with VulkanAllocator::BeginTrace (F2).
+//
+//Usage: AllocatorBenchmark [-trace <file>] [-operations <count>] [-seed <seed>] [-blocksize <MB>] [-granularity <bytes>] [-fuzz <iterations>]
+//Returns a non-zero exit code when the fuzzer finds overlapping or misaligned ranges.
+
+namespace
+{
+	const uint64 MEGABYTE = 1024 * 1024;
+	//Fragmentation is sampled instead of measured after every operation, it walks all blocks
+	const uint32 FRAGMENTATION_SAMPLE_INTERVAL = 64;
+	//Share of the synthetic allocations that are images
+	const float IMAGE_CHANCE = 0.3f;
+
+	struct TraceOperation
+	{
+		bool Allocate = true;
+		uint32 Id = 0;
+		uint64 Size = 0;
+		uint64 Alignment = 0;
+		//Images are padded to the buffer image granularity
+		bool Image = false;
+	};
+	using Trace = std::vector<TraceOperation>;
+
+	struct ReplayResult
+	{
+		uint32 Allocations = 0;
+		uint32 Frees = 0;
+		uint32 Failures = 0;
+		uint32 DedicatedAllocations = 0;
+		double AllocateNs = 0.0;
+		double FreeNs = 0.0;
+		float PeakFragmentation = 0.0f;
+		uint64 PeakPaddingSize = 0;
+		uint64 PeakUsedSize = 0;
+		uint64 ReservedSize = 0;
+		uint32 BlockCount = 0;
+		std::string Error;
+	};
+
+	struct Allocation
+	{
+		MemoryBlock* pBlock = nullptr;
+		uint32 Handle = TLSFAllocator::INVALID_HANDLE;
+		VkDeviceSize Offset = 0;
+		VkDeviceSize Size = 0;
+		VkDeviceMemory DedicatedMemory = VK_NULL_HANDLE;
+	};
+
+	uint64 GetUsedSize(const MemoryPool& pool)
+	{
+		uint64 size = 0;
+		for (const auto& pBlock : pool.Blocks)
+		{
+			size += pBlock->pAllocator->GetUsedSize();
+		}
+		return size;
+	}
+
+	uint64 GetPaddingSize(const MemoryPool& pool)
+	{
+		uint64 size = 0;
+		for (const auto& pBlock : pool.Blocks)
+		{
+			size += pBlock->pAllocator->GetPaddingSize();
+		}
+		return size;
+	}
+
+	//1 - largest free range / free size, over all blocks
+	float GetFragmentation(const MemoryPool& pool)
+	{
+		uint64 freeSize = 0;
+		uint64 largestFreeRange = 0;
+		for (const auto& pBlock : pool.Blocks)
+		{
+			freeSize += pBlock->pAllocator->GetSize() - pBlock->pAllocator->GetUsedSize();
+			largestFreeRange = std::max(largestFreeRange, pBlock->pAllocator->GetLargestFreeRange());
+		}
+		if (freeSize == 0)
+		{
+			return 0.0f;
+		}
+		return 1.0f - (float)largestFreeRange / freeSize;
+	}
+
+	//Sizes are log-uniform so small buffers are far more common than large textures, like in a real scene.
+	//Allocations and frees are balanced around 'workingSetSize' live bytes
+	void GenerateSyntheticTrace(uint32 operationCount, uint32 seed, uint64 maxSize, uint64 workingSetSize, Trace& trace)
+	{
+		const uint64 alignments[] = { 16, 256, 256, 4096, 65536 };
+
+		std::mt19937 generator(seed);
+		std::uniform_real_distribution<double> sizeDistribution(std::log(256.0), std::log((double)maxSize));
+		std::uniform_int_distribution<uint32> alignmentDistribution(0, (uint32)(sizeof(alignments) / sizeof(alignments[0])) - 1);
+		std::uniform_real_distribution<float> chanceDistribution(0.0f, 1.0f);
+
+		std::vector<uint32> liveIds;
+		std::vector<uint64> sizes;
+		uint64 liveSize = 0;
+		uint32 nextId = 0;
+		for (uint32 i = 0; i < operationCount; ++i)
+		{
+			TraceOperation operation;
+			float freeChance = liveSize > workingSetSize ? 0.9f : 0.3f;
+			if (liveIds.size() > 0 && chanceDistribution(generator) < freeChance)
+			{
+				std::uniform_int_distribution<size_t> indexDistribution(0, liveIds.size() - 1);
+				size_t index = indexDistribution(generator);
+				operation.Allocate = false;
+				operation.Id = liveIds[index];
+				liveSize -= sizes[operation.Id];
+				liveIds[index] = liveIds.back();
+				liveIds.pop_back();
+			}
+			else
+			{
+				operation.Allocate = true;
+				operation.Id = nextId++;
+				operation.Size = (uint64)std::exp(sizeDistribution(generator));
+				operation.Alignment = alignments[alignmentDistribution(generator)];
+				operation.Image = chanceDistribution(generator) < IMAGE_CHANCE;
+				liveIds.push_back(operation.Id);
+				sizes.push_back(operation.Size);
+				liveSize += operation.Size;
+			}
+			trace.push_back(operation);
+		}
+
+		for (uint32 id : liveIds)
+		{
+			TraceOperation operation;
+			operation.Allocate = false;
+			operation.Id = id;
+			trace.push_back(operation);
+		}
+	}
+
+	//Recorded lines are "a <memory> <offset> <size> <alignment>" and "f <memory> <offset>".
+	//Image requirements are recorded after the granularity padding so every operation replays as a buffer
+	bool LoadTrace(const std::string& filePath, Trace& trace)
+	{
+		std::ifstream file(filePath);
+		if (file.fail())
+		{
+			return false;
+		}
+
+		std::map<std::pair<uint64, uint64>, uint32> liveIds;
+		uint32 nextId = 0;
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::stringstream stream(line);
+			char type;
+			uint64 memory, offset;
+			stream >> type >> memory >> offset;
+
+			TraceOperation operation;
+			if (type == 'a')
+			{
+				operation.Allocate = true;
+				operation.Id = nextId++;
+				stream >> operation.Size >> operation.Alignment;
+				liveIds[std::make_pair(memory, offset)] = operation.Id;
+			}
+			else if (type == 'f')
+			{
+				//Frees of allocations made before the recording started are skipped
+				auto it = liveIds.find(std::make_pair(memory, offset));
+				if (it == liveIds.end())
+				{
+					continue;
+				}
+				operation.Allocate = false;
+				operation.Id = it->second;
+				liveIds.erase(it);
+			}
+			else
+			{
+				continue;
+			}
+			trace.push_back(operation);
+		}
+		return true;
+	}
+
+	//Checks a new range against the live ranges of its block
+	bool ValidateRange(std::map<const MemoryBlock*, std::map<uint64, uint64>>& blockRanges, const Allocation& allocation, uint64 alignment, std::string& error)
+	{
+		std::stringstream message;
+		std::map<uint64, uint64>& ranges = blockRanges[allocation.pBlock];
+
+		uint64 end = allocation.Offset + allocation.Size;
+		if (allocation.Offset % alignment != 0)
+		{
+			message << "Offset " << allocation.Offset << " is not aligned to " << alignment;
+		}
+		else if (end > allocation.pBlock->pAllocator->GetSize())
+		{
+			message << "Range [" << allocation.Offset << ", " << end << ") exceeds block size " << allocation.pBlock->pAllocator->GetSize();
+		}
+		else
+		{
+			auto next = ranges.lower_bound(allocation.Offset);
+			if (next != ranges.end() && next->first < end)
+			{
+				message << "Range [" << allocation.Offset << ", " << end << ") overlaps [" << next->first << ", " << next->first + next->second << ")";
+			}
+			else if (next != ranges.begin() && std::prev(next)->first + std::prev(next)->second > allocation.Offset)
+			{
+				auto prev = std::prev(next);
+				message << "Range [" << allocation.Offset << ", " << end << ") overlaps [" << prev->first << ", " << prev->first + prev->second << ")";
+			}
+		}
+
+		error = message.str();
+		if (error.size() > 0)
+		{
+			error = "Block " + std::to_string((uint64)(size_t)allocation.pBlock->Memory) + ": " + error;
+			return false;
+		}
+		ranges[allocation.Offset] = allocation.Size;
+		return true;
+	}
+
+	//Requests go through the same dedicated memory and block selection as in VulkanAllocator
+	bool Replay(const Trace& trace, uint64 blockSize, uint64 granularity, uint64 budget, bool validate, ReplayResult& result)
+	{
+		NullMemoryBackend backend(budget);
+		MemoryPool pool;
+		pool.BlockSize = blockSize;
+		std::vector<Allocation> allocations;
+		std::vector<bool> allocated;
+		std::map<const MemoryBlock*, std::map<uint64, uint64>> blockRanges;
+		uint64 trackedUsedSize = 0;
+
+		for (size_t i = 0; i < trace.size(); ++i)
+		{
+			const TraceOperation& operation = trace[i];
+			if (operation.Id >= allocations.size())
+			{
+				allocations.resize(operation.Id + 1);
+				allocated.resize(operation.Id + 1, false);
+			}
+			Allocation& allocation = allocations[operation.Id];
+
+			if (operation.Allocate)
+			{
+				VkMemoryRequirements requirements;
+				requirements.size = operation.Size;
+				requirements.alignment = std::max<uint64>(operation.Alignment, 1);
+				requirements.memoryTypeBits = 1;
+				if (operation.Image)
+				{
+					MemoryPool::AlignToGranularity(requirements, granularity);
+				}
+
+				allocation = Allocation();
+				bool success;
+				auto startTime = std::chrono::high_resolution_clock::now();
+				if (pool.NeedsDedicatedMemory(requirements.size))
+				{
+					void* pCpuPointer;
+					success = backend.AllocateMemory(pool.MemoryTypeIndex, requirements.size, false, nullptr, allocation.DedicatedMemory, pCpuPointer);
+				}
+				else
+				{
+					allocation.pBlock = pool.Allocate(backend, requirements, 0, allocation.Offset, allocation.Handle);
+					success = allocation.pBlock != nullptr;
+				}
+				result.AllocateNs += std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - startTime).count();
+				++result.Allocations;
+
+				if (success == false)
+				{
+					++result.Failures;
+					continue;
+				}
+				allocation.Size = requirements.size;
+				allocated[operation.Id] = true;
+				if (allocation.pBlock == nullptr)
+				{
+					++result.DedicatedAllocations;
+				}
+				else if (validate)
+				{
+					if (ValidateRange(blockRanges, allocation, requirements.alignment, result.Error) == false)
+					{
+						return false;
+					}
+					trackedUsedSize += allocation.Size;
+				}
+			}
+			else
+			{
+				if (allocated[operation.Id] == false)
+				{
+					continue;
+				}
+				auto startTime = std::chrono::high_resolution_clock::now();
+				if (allocation.pBlock == nullptr)
+				{
+					backend.FreeMemory(allocation.DedicatedMemory, nullptr);
+				}
+				else
+				{
+					allocation.pBlock->pAllocator->Free(allocation.Handle);
+				}
+				result.FreeNs += std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - startTime).count();
+				++result.Frees;
+
+				allocated[operation.Id] = false;
+				if (validate && allocation.pBlock != nullptr)
+				{
+					blockRanges[allocation.pBlock].erase(allocation.Offset);
+					trackedUsedSize -= allocation.Size;
+				}
+			}
+
+			uint64 usedSize = GetUsedSize(pool);
+			if (validate && usedSize != trackedUsedSize)
+			{
+				result.Error = "Used size " + std::to_string(usedSize) + " does not match the live allocations " + std::to_string(trackedUsedSize);
+				return false;
+			}
+
+			result.PeakUsedSize = std::max(result.PeakUsedSize, usedSize);
+			result.PeakPaddingSize = std::max(result.PeakPaddingSize, GetPaddingSize(pool));
+			if (i % FRAGMENTATION_SAMPLE_INTERVAL == 0)
+			{
+				result.PeakFragmentation = std::max(result.PeakFragmentation, GetFragmentation(pool));
+			}
+		}
+
+		result.ReservedSize = backend.GetAllocatedSize();
+		result.BlockCount = (uint32)pool.Blocks.size();
+		if (validate)
+		{
+			//Everything was freed, every block has to be a single free range again
+			for (const auto& pBlock : pool.Blocks)
+			{
+				if (pBlock->pAllocator->IsEmpty() && pBlock->pAllocator->GetLargestFreeRange() != pBlock->pAllocator->GetSize())
+				{
+					result.Error = "Block " + std::to_string((uint64)(size_t)pBlock->Memory) + " did not coalesce after all allocations were freed";
+					return false;
+				}
+			}
+			if (backend.GetMemoryCount() != pool.Blocks.size())
+			{
+				result.Error = "Dedicated memory was not freed";
+				return false;
+			}
+		}
+		pool.DestroyBlocks(backend);
+		return true;
+	}
+
+	void PrintResult(const std::string& name, const ReplayResult& result)
+	{
+		std::cout << name << std::endl;
+		std::cout << "\tAllocations:          " << result.Allocations << " (" << result.Failures << " failed, " << result.DedicatedAllocations << " dedicated)" << std::endl;
+		std::cout << "\tFrees:                " << result.Frees << std::endl;
+		std::cout << "\tAllocate:             " << (result.Allocations > 0 ? result.AllocateNs / result.Allocations : 0.0) << " ns" << std::endl;
+		std::cout << "\tFree:                 " << (result.Frees > 0 ? result.FreeNs / result.Frees : 0.0) << " ns" << std::endl;
+		std::cout << "\tPeak fragmentation:   " << result.PeakFragmentation * 100.0f << "%" << std::endl;
+		std::cout << "\tPeak used:            " << result.PeakUsedSize / MEGABYTE << " MB" << std::endl;
+		std::cout << "\tPeak alignment waste: " << result.PeakPaddingSize << " bytes" << std::endl;
+		std::cout << "\tReserved:             " << result.ReservedSize / MEGABYTE << " MB in " << result.BlockCount << " blocks" << std::endl;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::string traceFile;
+	uint32 operationCount = 100000;
+	uint32 seed = 0;
+	uint64 blockSize = 256 * MEGABYTE;
+	//Common on desktop GPUs
+	uint64 granularity = 1024;
+	uint32 fuzzIterations = 0;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string argument = argv[i];
+		if (argument == "-trace")
+		{
+			traceFile = argv[i + 1];
+		}
+		else if (argument == "-operations")
+		{
+			operationCount = (uint32)std::stoul(argv[i + 1]);
+		}
+		else if (argument == "-seed")
+		{
+			seed = (uint32)std::stoul(argv[i + 1]);
+		}
+		else if (argument == "-blocksize")
+		{
+			blockSize = std::stoull(argv[i + 1]) * MEGABYTE;
+		}
+		else if (argument == "-granularity")
+		{
+			granularity = std::stoull(argv[i + 1]);
+		}
+		else if (argument == "-fuzz")
+		{
+			fuzzIterations = (uint32)std::stoul(argv[i + 1]);
+		}
+		else
+		{
+			std::cout << "Unknown argument '" << argument << "'" << std::endl;
+			return 1;
+		}
+	}
+
+	Trace trace;
+	if (traceFile.size() > 0)
+	{
+		if (LoadTrace(traceFile, trace) == false)
+		{
+			std::cout << "Failed to open trace '" << traceFile << "'" << std::endl;
+			return 1;
+		}
+	}
+	else
+	{
+		GenerateSyntheticTrace(operationCount, seed, 32 * MEGABYTE, 1024 * MEGABYTE, trace);
+	}
+
+	ReplayResult result;
+	Replay(trace, blockSize, granularity, ~0ull, false, result);
+	PrintResult(traceFile.size() > 0 ? traceFile : "Synthetic trace (seed " + std::to_string(seed) + ")", result);
+
+	//Small blocks and sizes make splits, merges and block overflow happen a lot more often.
+	//The largest sizes go to dedicated memory and the budget makes the pool retry with smaller blocks
+	for (uint32 i = 0; i < fuzzIterations; ++i)
+	{
+		Trace fuzzTrace;
+		GenerateSyntheticTrace(2000, seed + i, MEGABYTE, 4 * MEGABYTE, fuzzTrace);
+		ReplayResult fuzzResult;
+		if (Replay(fuzzTrace, MEGABYTE, granularity, 8 * MEGABYTE, true, fuzzResult) == false)
+		{
+			std::cout << "Fuzz iteration " << i << " (seed " << seed + i << ") failed: " << fuzzResult.Error << std::endl;
+			return 1;
+		}
+	}
+	if (fuzzIterations > 0)
+	{
+		std::cout << "Fuzzing passed " << fuzzIterations << " iterations" << std::endl;
+	}
+	return 0;
+}
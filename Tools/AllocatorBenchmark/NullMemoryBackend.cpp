@@ -0,0 +1,33 @@
+#include "stdafx.h"
+#include "NullMemoryBackend.h"
+
+NullMemoryBackend::NullMemoryBackend(uint64 budget) :
+	m_Budget(budget)
+{
+}
+
+NullMemoryBackend::~NullMemoryBackend()
+{
+}
+
+bool NullMemoryBackend::AllocateMemory(uint32 /*memoryTypeIndex*/, VkDeviceSize size, bool /*map*/, const void* /*pNext*/, VkDeviceMemory& memory, void*& pCpuPointer)
+{
+	if (size > m_Budget - m_AllocatedSize)
+	{
+		return false;
+	}
+	uint64 handle = m_NextHandle++;
+	m_Sizes[handle] = size;
+	m_AllocatedSize += size;
+	memory = (VkDeviceMemory)(size_t)handle;
+	pCpuPointer = nullptr;
+	return true;
+}
+
+void NullMemoryBackend::FreeMemory(VkDeviceMemory memory, void* /*pCpuPointer*/)
+{
+	auto it = m_Sizes.find((uint64)(size_t)memory);
+	assert(it != m_Sizes.end());
+	m_AllocatedSize -= it->second;
+	m_Sizes.erase(it);
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "Core/MemoryPool.h"
+
+//Hands out handles to memory that doesn't exist so the allocator's pools run without a GPU.
+//A budget makes allocations fail like a device that is out of memory
+class NullMemoryBackend : public MemoryBackend
+{
+public:
+	NullMemoryBackend(uint64 budget = ~0ull);
+	virtual ~NullMemoryBackend();
+
+	virtual bool AllocateMemory(uint32 memoryTypeIndex, VkDeviceSize size, bool map, const void* pNext, VkDeviceMemory& memory, void*& pCpuPointer) override;
+	virtual void FreeMemory(VkDeviceMemory memory, void* pCpuPointer) override;
+
+	uint64 GetAllocatedSize() const { return m_AllocatedSize; }
+	uint32 GetMemoryCount() const { return (uint32)m_Sizes.size(); }
+
+private:
+	uint64 m_Budget;
+	uint64 m_AllocatedSize = 0;
+	uint64 m_NextHandle = 1;
+	std::map<uint64, uint64> m_Sizes;
+};
@@ -25,6 +25,8 @@ workspace "VulkanBase"
 		files
 		{ 
 			"../Source/**",
+			"../Resources/Shaders/**.vert",
+			"../Resources/Shaders/**.frag",
 		}
 
 		includedirs 
@@ -52,6 +54,19 @@ workspace "VulkanBase"
 			"{COPY} \"$(SolutionDir)external\\SDL2-2.0.7\\lib\\%{cfg.platform}\\SDL2.dll\" \"$(OutDir)\"",
 		}
 
+		--Shaders are compiled to SPIR-V next to their source whenever they change so the binaries never go stale
+		filter { "files:../Resources/Shaders/**.vert or ../Resources/Shaders/**.frag" }
+			buildmessage "Compiling %{file.name}"
+			buildcommands
+			{
+				"\"%{file.directory}/glslangValidator.exe\" -V \"%{file.abspath}\" -o \"%{file.directory}/%{file.name}.spv\"",
+			}
+			buildoutputs
+			{
+				"%{file.directory}/%{file.name}.spv",
+			}
+		filter {}
+
 		filter { "platforms:x86" }
 			libdirs
 			{
@@ -64,6 +79,32 @@ workspace "VulkanBase"
 				"../external/VulkanSDK/1.1.77.0/Lib"
 			}
 
+	project "AllocatorBenchmark"
+		filename "AllocatorBenchmark"
+   		rtti "Off"
+		location "../"
+		targetdir "../Build/$(ProjectName)_$(Platform)_$(Configuration)"
+		objdir "!../Build/Intermediate/$(ProjectName)_$(Platform)_$(Configuration)"
+		kind "ConsoleApp"
+
+		--Runs the memory pools of the allocator without a device so it can run on machines without a GPU
+		files
+		{ 
+			"../Tools/AllocatorBenchmark/**",
+			"../Source/Core/TLSFAllocator.h",
+			"../Source/Core/TLSFAllocator.cpp",
+			"../Source/Core/MemoryPool.h",
+			"../Source/Core/MemoryPool.cpp",
+		}
+
+		includedirs 
+		{ 
+			"$(ProjectDir)/Source",
+			"../external/SDL2-2.0.7/include",
+			"../external/VulkanSDK/1.1.77.0/include",
+			"../external/glm",
+		}
+
 newaction {
 	trigger     = "clean",
 	description = "Remove all binaries and generated files",